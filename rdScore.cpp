@@ -1,6 +1,6 @@
 // rdScore.cpp (v1.1.4 candidate - menu, open/print, basic setlist dialog, single-field extract)
 // Build:
-//   g++ -O2 -std=c++17 rdScore.cpp -o rdScore $(pkg-config --cflags --libs gtk+-3.0 poppler-glib)
+//   g++ -O2 -std=c++17 rdScore.cpp -o rdScore $(pkg-config --cflags --libs gtk+-3.0 poppler-glib libqpdf)
 
 #include <gtk/gtk.h>
 #include <poppler.h>
@@ -19,10 +19,28 @@
 #include <cctype>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 #include <cerrno>
 #include <cstring>
+#include <ctime>
 #include <filesystem>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
+#include <tuple>
+#include <atomic>
+#include <memory>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RDSCORE_X86_SIMD 1
+#endif
 
 static std::string get_setlists_directory() {
   const char* home = getenv("HOME");
@@ -56,12 +74,487 @@ static std::string basename_only(const std::string& path) {
   return out;
 }
 
+// first value of a one-line sysfs/procfs file; 0 when missing or "max"
+static unsigned long long read_limit_file(const std::string& path) {
+  std::ifstream in(path);
+  std::string v;
+  if (!(in >> v) || v == "max") return 0;
+  return strtoull(v.c_str(), nullptr, 10);
+}
+
+// Smallest memory limit of the cgroups this process runs in (e.g. under
+// systemd-run -p MemoryMax=...), 0 when unlimited.
+static unsigned long long cgroup_memory_limit() {
+  unsigned long long best = 0;
+  auto consider = [&best](unsigned long long v) {
+    if (v > 0 && v < (1ULL << 60) && (best == 0 || v < best)) best = v;
+  };
+
+  std::ifstream in("/proc/self/cgroup");
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.rfind("0::", 0) == 0) { // cgroup v2: the limit may sit on any ancestor
+      std::string dir = line.substr(3);
+      while (true) {
+        consider(read_limit_file("/sys/fs/cgroup" + dir + "/memory.max"));
+        if (dir.empty() || dir == "/") break;
+        dir = dir.substr(0, dir.rfind('/'));
+      }
+    } else {
+      const size_t pos = line.find(":memory:"); // cgroup v1
+      if (pos != std::string::npos)
+        consider(read_limit_file("/sys/fs/cgroup/memory" + line.substr(pos + 8) + "/memory.limit_in_bytes"));
+    }
+  }
+  return best;
+}
+
+static unsigned long long mem_available_bytes() {
+  std::ifstream in("/proc/meminfo");
+  std::string key;
+  unsigned long long kb = 0;
+  std::string unit;
+  while (in >> key >> kb >> unit) {
+    if (key == "MemAvailable:") return kb * 1024ULL;
+  }
+  return 0;
+}
+
+// Default cache budget: a third of what this process may use (cgroup limit or
+// available RAM, whichever is smaller), between 64 MiB and 1 GiB.
+static size_t default_memory_budget() {
+  const unsigned long long cg = cgroup_memory_limit();
+  const unsigned long long avail = mem_available_bytes();
+  unsigned long long base = cg;
+  if (avail > 0 && (base == 0 || avail < base)) base = avail;
+  if (base == 0) return (size_t)256 << 20;
+
+  const unsigned long long lo = 64ULL << 20, hi = 1ULL << 30;
+  return (size_t)std::max(lo, std::min(hi, base / 3));
+}
+
 static const char* RDSCORE_VERSION = "1.1.4";
 
+// ===== Memory budget: one byte budget shared by every cache (rendered pages, tiles,
+// previews, thumbnails, the library index, the setlist catalog and document data).
+// Pixel caches live in the render cache, which evicts down to whatever the other
+// holders have not reserved, but always keeps a quarter of the budget. Reserved:
+// the resident pages of the mapped documents, each PopplerDocument on them (render
+// workers, main thread, search, preload), the preloaded next setlist piece, the
+// cached extraction QPDF, the library index, the setlist catalog, scan images and
+// the retained spread. Not charged: the QPDF scan detection parses lazily (only the
+// content streams of candidate pages).
+struct MemoryBudget {
+  size_t limit = (size_t)256 << 20;
+  std::atomic<size_t> reserved{0}; // held outside the render cache (e.g. document data)
+};
+
+// Parser state of a PopplerDocument or QPDF on a file (xref, object and font caches)
+// cannot be measured from outside: charged as a quarter of the file size, at most
+// 64 MiB (it grows with the number of objects, not with image data).
+static size_t document_state_estimate(size_t file_bytes) {
+  return std::min(file_bytes / 4, (size_t)64 << 20);
+}
+
+// Pages of a mapped file that are in memory; untouched pages cost nothing.
+static size_t mapped_resident_bytes(GBytes* bytes) {
+  if (!bytes) return 0;
+  gsize size = 0;
+  const char* data = (const char*)g_bytes_get_data(bytes, &size);
+  const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  const uintptr_t start = (uintptr_t)data & ~(uintptr_t)(page - 1);
+  const size_t len = (uintptr_t)data + size - start;
+  std::vector<unsigned char> vec((len + page - 1) / page);
+  if (size == 0 || mincore((void*)start, len, vec.data()) != 0) return size;
+  size_t n = 0;
+  for (unsigned char v : vec) n += v & 1;
+  return std::min((size_t)size, n * page);
+}
+
+// Replaces the charge held in charged by bytes.
+static void memory_budget_recharge(MemoryBudget* b, size_t& charged, size_t bytes) {
+  b->reserved -= charged;
+  charged = bytes;
+  b->reserved += charged;
+}
+
+static size_t memory_budget_cache_limit(const MemoryBudget* b) {
+  const size_t reserved = b->reserved.load();
+  return std::max(b->limit / 4, (reserved >= b->limit) ? 0 : b->limit - reserved);
+}
+
+// Charges bytes before they are allocated, unless that would leave the render cache
+// less than half of the budget.
+static bool memory_budget_try_reserve(MemoryBudget* b, size_t bytes) {
+  size_t cur = b->reserved.load();
+  do {
+    if (cur + bytes > b->limit / 2) return false;
+  } while (!b->reserved.compare_exchange_weak(cur, cur + bytes));
+  return true;
+}
+
+// ===== Render engine: pages are rasterized on a worker thread into image surfaces
+// and kept in an LRU cache, so on_draw only has to blit.
+struct RenderKey {
+  unsigned doc_id = 0; // bumped on every document change, so stale renders never match
+  int page = -1;
+  int scale_key = 0;   // effective scale * 10000, rounded
+  int tile_x = -1;     // tile column/row at that scale, -1 = whole page
+  int tile_y = -1;
+  bool preview = false; // quick low-resolution stand-in (or the embedded thumbnail)
+
+  bool operator<(const RenderKey& o) const {
+    return std::tie(doc_id, page, scale_key, tile_x, tile_y, preview) <
+           std::tie(o.doc_id, o.page, o.scale_key, o.tile_x, o.tile_y, o.preview);
+  }
+  bool operator==(const RenderKey& o) const {
+    return doc_id == o.doc_id && page == o.page && scale_key == o.scale_key &&
+           tile_x == o.tile_x && tile_y == o.tile_y && preview == o.preview;
+  }
+};
+
+static const int RENDER_TILE_SIZE = 512; // pixels, zoomed views are rendered in tiles
+
+struct RenderJob {
+  RenderKey key;
+  double scale = 1.0;
+  bool visible = false; // part of the spread currently on screen
+  bool transform = false; // make the night/sepia copy of the cached key, no render
+};
+
+// Night and sepia are pixel transforms of the cached renderings, never a second render.
+enum DisplayMode { DISPLAY_NORMAL, DISPLAY_NIGHT, DISPLAY_SEPIA };
+
+// The copies are made by the render workers (with each render, and for everything
+// cached when the mode changes); on_draw only picks them up.
+struct RenderCacheEntry {
+  RenderKey key;
+  cairo_surface_t* surface = nullptr;
+  cairo_surface_t* display = nullptr; // surface transformed for display_mode (not NORMAL)
+  DisplayMode display_mode = DISPLAY_NORMAL;
+  size_t bytes = 0;                   // both surfaces
+};
+
+// Whole pages and previews kept across runs as PNG files in $XDG_CACHE_HOME/rdscore/pages,
+// named after the file identity (path, size, mtime), page and scale. LRU by file mtime
+// across runs; in memory, an index built once at startup. PNG encoding and writing
+// happen on a low-priority writer thread, never on a render worker.
+struct DiskCacheWrite {
+  std::string name;
+  cairo_surface_t* surf; // a reference owned by the queue
+};
+
+struct DiskCache {
+  std::string dir;                    // empty = disabled
+  size_t limit = (size_t)256 << 20;   // --disk-cache-mb=N
+  std::mutex mu;
+  std::list<std::string> lru;         // file names, front = most recently used
+  std::map<std::string, std::pair<size_t, std::list<std::string>::iterator>> files; // name -> (size, lru)
+  size_t bytes = 0;
+  std::deque<DiskCacheWrite> queue;
+  std::set<std::string> queued;       // names in queue
+  std::condition_variable cv;         // queue or quit changed
+  bool quit = false;
+  std::thread writer;
+};
+
+// Scanned pages (see draw_scan_page). Placement of the page image, from the content stream.
+struct ScanInfo {
+  int image_id = -1;      // -1 = not a scan, render normally
+  PopplerRectangle area;  // image placement, PDF points from the top-left corner of the crop box
+  int img_w = 0;          // pixels, from the image dictionary
+  int img_h = 0;
+};
+
+// One page image shared by the render workers, downsampled from the decode: [0] the
+// smallest power-of-two reduction at least as wide as the drawing asked for, [k] that
+// reduced k times by 2. Only these are charged to the budget (the full-resolution
+// decode is freed as soon as [0] is made), until the last user drops them.
+struct ScanImage {
+  int page = -1;
+  int base_w = 0;         // width of [0], known before the decode
+  std::vector<cairo_surface_t*> levels;
+  size_t bytes = 0;
+  MemoryBudget* budget = nullptr;
+  bool ready = false;     // decode finished (levels empty: it failed)
+};
+
+struct ScanStore {
+  std::mutex mu;
+  std::condition_variable cv;  // a decode finished
+  unsigned doc_id = 0;
+  GBytes* doc_bytes = nullptr; // what pdf reads, kept alive with it
+  std::unique_ptr<QPDF> pdf;   // content streams and image dictionaries, parsed on first use
+  bool pdf_failed = false;
+  std::map<int, ScanInfo> info;                 // page -> detection
+  std::list<std::shared_ptr<ScanImage>> images; // front = most recently used
+  MemoryBudget* budget = nullptr;
+};
+
+struct RenderEngine {
+  std::vector<std::thread> workers;
+  std::mutex mu;
+  std::condition_variable cv;
+  bool quit = false;
+
+  // Each worker opens its own PopplerDocument on doc_bytes: Poppler objects
+  // must not be shared between threads, the mapped file is.
+  unsigned doc_id = 0;
+  GBytes* doc_bytes = nullptr;
+  std::string disk_id; // identity of the document in the disk cache
+  DiskCache* disk = nullptr;
+  size_t doc_charge = 0;    // reserved for the main thread's PopplerDocument
+  size_t mapped_charge = 0; // reserved for the resident pages of doc_bytes (main thread)
+  gint64 mapped_checked = 0;
+
+  std::deque<RenderJob> queue;
+  std::set<RenderKey> pending; // queued or being rendered
+  std::set<RenderKey> pinned;  // on screen, never evicted
+  std::set<RenderKey> transforming; // transform jobs queued
+
+  std::list<RenderCacheEntry> lru; // front = most recently used
+  std::map<RenderKey, std::list<RenderCacheEntry>::iterator> index;
+  // Whole-page renderings (previews, pyramid levels, exact scales) by (doc_id, page),
+  // for the stale fallback: a few entries per page, whatever the cache size.
+  std::map<std::pair<unsigned, int>, std::vector<std::list<RenderCacheEntry>::iterator>> pages;
+  size_t bytes = 0;
+  MemoryBudget* budget = nullptr;
+  DisplayMode display = DISPLAY_NORMAL; // what lookups return
+
+  bool notify_queued = false;
+  ScanStore scan; // decoded scans, shared by the workers
+};
+
+// ===== Instrumentation: render/draw latency histograms and cache counters,
+// shown in the HUD (key i) and written as JSON (Ctrl+I, --stats-file=PATH).
+struct Histogram {
+  static const int BUCKETS = 64; // log-spaced, 4 per octave from 0.05 ms (last bucket ~3.3 s and above)
+  uint64_t counts[BUCKETS] = {};
+  uint64_t n = 0;
+  double sum_ms = 0.0;
+  double max_ms = 0.0;
+};
+
+struct PageRenderStat {
+  uint64_t renders = 0;
+  double total_ms = 0.0;
+  double max_ms = 0.0;
+};
+
+struct RenderStats {
+  std::mutex mu; // render_ms and pages are written by the render worker
+  unsigned doc_id = 0; // render samples of other documents (finishing late) are dropped
+  Histogram render_ms;                  // one sample per rasterized page, tile or preview
+  Histogram draw_ms;                    // one sample per on_draw with a document
+  std::map<int, PageRenderStat> pages;  // current document, by 0-based page
+  std::atomic<uint64_t> cache_hits{0};   // exact rendering found when drawing
+  std::atomic<uint64_t> cache_misses{0}; // stand-in or blank drawn instead
+};
+
+// Page size in PDF points; read once for every page when a document is loaded.
+struct PageSize {
+  double w = 0;
+  double h = 0;
+};
+
+// A page placed at its effective scale.
+struct PageSlot {
+  int page;
+  double x, y, w, h;
+};
+
+// Placement of the current spread. Slots are relative to the top-left corner of
+// the content box (margins included); on_draw adds the centering offset.
+struct Layout {
+  bool valid = false;
+
+  // inputs: recomputed only when one of these changes
+  unsigned doc_id = 0;
+  int left = -1;
+  bool two_pages = false;
+  double zoom = 0.0;
+  int VW = 0;
+  int VH = 0;
+
+  double scale = 1.0;
+  PageSlot slots[2];
+  int n_slots = 0;
+  double contentW = 0;
+  double contentH = 0;
+};
+
+// Zoomed views: the visible tiles plus a one-tile margin composited into one surface,
+// so scrolling inside it is a single blit instead of per-tile cache lookups. The
+// surface wraps around (drawing-area pixel (x, y) is kept at (x mod width, y mod
+// height)): when the view leaves rect, rect follows it and only the strips that came
+// into view are composited; the rest stays where it is.
+struct RetainedSpread {
+  cairo_surface_t* surf = nullptr;
+  GdkRectangle rect = { 0, 0, 0, 0 }; // drawing-area coordinates, surface size
+  size_t bytes = 0;                   // charged to the memory budget
+  bool valid = false;                 // surf holds rect for the fields below
+  unsigned doc_id = 0;
+  int left = -1;
+  bool two_pages = false;
+  int scale_key = 0;
+  DisplayMode display = DISPLAY_NORMAL;
+  int W = 0;
+  int H = 0;
+};
+
+// A page rendered while its document was still being loaded.
+struct PreRendered {
+  int page;
+  double scale;
+  cairo_surface_t* surf;
+};
+
+// A PDF opened and measured by open_document_file (on any thread).
+struct DocumentLoad {
+  std::string abs_path;
+  GBytes* bytes = nullptr; // the file mapped once, shared with the render workers
+  std::string disk_id;     // disk cache identity (path, size, mtime)
+  PopplerDocument* doc = nullptr;
+  int n_pages = 0;
+  std::vector<PageSize> sizes;
+  std::string error; // message for the user; empty when cancelled
+  std::vector<PreRendered> first_spread; // seeded into the render cache on install
+};
+
+// Background open started by load_document_async. Owned by the loader thread
+// until it hands it to document_load_done_cb on the main thread.
+struct AppState;
+struct PendingLoad {
+  AppState* s = nullptr;
+  std::string path;
+  bool show_errors = true;
+  bool from_setlist = false;
+  std::atomic<bool> cancelled{false};
+  bool ok = false;
+  bool done = false; // result available (set on the main thread)
+  DocumentLoad result;
+
+  int play_index = -1;      // setlist item, when opened for playback
+  bool open_at_end = false; // paging back into the previous piece
+  int open_page = -1;       // library hit: page shown once loaded
+  void (*on_failure)(AppState*) = nullptr; // where the user came from; reopened if the open fails or Esc cancels it
+  guint done_source = 0;    // document_load_done_cb, queued by the loader thread
+  size_t charged = 0;       // reserved while held as a finished preload
+  // When prerender_VW > 0 the loader also prepares the first spread for this viewport:
+  // from the disk cache, else rendered when prerender_render is set.
+  bool prerender_render = false;
+  int prerender_VW = 0;
+  int prerender_VH = 0;
+  bool prerender_two_pages = false;
+  double prerender_zoom = 1.0;
+};
+
+// Library index (Ctrl+L): the words of every PDF listed in a setlist (metadata,
+// outline, page text), kept in $XDG_CACHE_HOME/rdscore/library.idx and refreshed by mtime.
+struct LibraryDoc {
+  std::string path;
+  long long mtime = 0;
+  long long size = 0;
+  std::string title; // document title, else file name
+  int n_pages = 0;
+};
+
+// term -> (doc, page) pairs sorted by doc then page. Metadata words point at
+// page 0, outline entries at their target page.
+struct LibraryIndex {
+  std::vector<LibraryDoc> docs;
+  std::map<std::string, std::vector<std::pair<uint32_t, uint32_t>>> terms;
+};
+
+struct LibraryDialog;
+
+// Pages for extraction, 1-based and inclusive.
+struct PageRange {
+  int from;
+  int to;
+};
+
+// One PDF written by an extraction: the ranges, in order.
+struct ExtractOutput {
+  std::vector<PageRange> ranges;
+  std::string out_abs;
+};
+
+// Extraction run by extract_run on extract_thread (extract_pages, --bench).
+// Owned by the thread until extract_done_cb. Esc cancels it; the file being written is removed.
+struct ExtractJob {
+  AppState* s = nullptr;
+  std::string in_abs;
+  unsigned doc_id = 0;         // document the cached source belongs to
+  std::unique_ptr<QPDF> src;   // taken from AppState::extract_src, handed back when done
+  std::vector<ExtractOutput> outputs;
+  std::atomic<bool> cancelled{false};
+  std::atomic<int> percent{0}; // of all outputs together
+  bool ok = false;
+  std::string message;         // for the user; empty when cancelled
+};
+
+// Setlist catalog: every setlist of the setlists directory with its items and
+// summary columns for Manage Setlists. Built on catalog_thread, refreshed when the
+// directory monitor reports a change; entries whose file mtime is unchanged are reused.
+struct SetlistInfo {
+  long long mtime = 0;     // seconds, shown
+  long long mtime_ns = 0;  // with st_size, decides whether items are still current
+  long long size = 0;
+  std::vector<std::string> items;
+  int missing = 0;      // items whose PDF does not exist
+  int total_pages = 0;  // of the existing items
+  int pages_unknown = 0; // existing items the library index has not counted (yet)
+};
+
+// Entry check for the setlist dialog: stat, then the %PDF- header and %%EOF trailer.
+// Run on a small pool of threads that closing the dialog only cancels (a hung mount
+// must not block it): they are joined once all of them are done, or at exit. Results
+// stream into the tree view while the job is the dialog's.
+enum EntryStatus { ENTRY_OK, ENTRY_MISSING, ENTRY_NOT_PDF, ENTRY_TRUNCATED, ENTRY_UNREADABLE };
+
+struct ValidationNotify;
+struct SetlistValidation {
+  std::vector<std::string> items;
+  std::vector<int> order;            // rows, from the one under the cursor
+  std::atomic<size_t> next{0};
+  std::atomic<bool> cancelled{false};
+
+  std::atomic<int> workers{0};       // threads still running
+
+  std::mutex mu;
+  std::vector<std::pair<int, EntryStatus>> results; // not yet shown
+  ValidationNotify* notify = nullptr; // setlist_validation_cb, while queued
+  guint notify_source = 0;
+};
+
+// Text search (/ or Ctrl+F) over the current document, run by search_thread on the
+// search PopplerDocument (opened once per document, reused by every query). Owned by
+// AppState; search_stop joins the thread before freeing it. Matches are streamed into
+// hits as pages are scanned.
+struct SearchJob {
+  AppState* s = nullptr;
+  std::string query;
+  GBytes* bytes = nullptr;
+  int n_pages = 0;
+  int first_page = 0; // scanning starts at the current spread and wraps around
+  std::atomic<bool> cancelled{false};
+  bool done = false;  // set on the main thread
+  guint done_source = 0; // search_done_cb, queued by the thread
+
+  std::mutex mu;
+  std::map<int, std::vector<PopplerRectangle>> hits; // page -> rectangles, points, top-left origin
+  int scanned = 0;
+};
+
 struct AppState {
   PopplerDocument* doc = nullptr;
+  PendingLoad* loading = nullptr; // document being opened; the current one stays visible
+  std::map<PendingLoad*, std::thread> load_threads; // joined by document_load_done_cb, or at exit
   int n_pages = 0;
   int current_left = 0;
+  std::vector<PageSize> page_sizes; // n_pages entries
+  Layout layout;
 
   bool two_pages = true;
   bool fullscreen = true; 
@@ -70,6 +563,14 @@ struct AppState {
   double zoom = 1.0;      // 1.0 = 100%
   int zoom_percent = 100; // cached for help/overlay
 
+  int prefetch_depth = 2; // spreads rendered ahead in the background (--prefetch=N)
+  int render_threads = 0; // render workers, 0 = one per core up to 4 (--render-threads=N)
+
+  // While the zoom keeps changing (e.g. Ctrl+ held down) only pyramid levels are
+  // rendered; the exact scale is queued once it has settled.
+  gint64 zoom_settle_until = 0; // g_get_monotonic_time() units
+  guint zoom_settle_timer = 0;
+
   // Zoom overlay (B)
   bool zoom_overlay = false;
   int zoom_overlay_percent = 100;
@@ -82,6 +583,12 @@ struct AppState {
 
   // For extraction (E)
   std::string input_pdf_abs; // absolute path to source PDF
+  std::unique_ptr<QPDF> extract_src; // input_pdf_abs parsed by the first extraction, kept while it is open
+  size_t extract_src_charge = 0;     // reserved for it in budget
+  ExtractJob* extracting = nullptr;  // running in the background
+  std::thread extract_thread;
+  std::atomic<bool> extract_notify_queued{false};
+  bool extract_last_ok = false;      // result of the last extraction that finished (--bench)
 
   // Setlist context / chooser memory
   std::string active_setlist_path;
@@ -93,6 +600,7 @@ struct AppState {
   GtkWidget* window = nullptr;
   GtkWidget* scrolled = nullptr;
   GtkWidget* drawing = nullptr;
+  GtkWidget* overlay_area = nullptr; // transparent layer above the viewport: overlays, HUD, badges
   GtkWidget* menubar = nullptr;
   GtkWidget* menu_file = nullptr;
   GtkWidget* menu_setlists = nullptr;
@@ -102,6 +610,67 @@ struct AppState {
   // last computed content size (for size_request)
   int contentW = 1200;
   int contentH = 800;
+
+  MemoryBudget budget;
+  RenderEngine render;
+  DiskCache disk;
+
+  RenderStats stats;
+  bool show_hud = false;
+  GdkRectangle hud_rect = { 0, 0, 0, 0 };   // painted by the last overlay draw, empty if none
+  GdkRectangle badge_rect = { 0, 0, 0, 0 };
+  std::string badge_measured;         // text badge_text_w was measured for
+  int badge_text_w = 0;
+  cairo_t* badge_measure_cr = nullptr; // on a 1x1 surface, for text extents only
+
+  RetainedSpread retained;
+
+  GtkWidget* search_entry = nullptr; // shown above the viewport while searching
+  SearchJob* search = nullptr;       // current query, running or finished
+  std::thread search_thread;         // runs search; joined by search_stop
+  PopplerDocument* search_doc = nullptr; // used by search_thread only while it runs
+  GBytes* search_doc_bytes = nullptr;    // what search_doc was opened on
+  size_t search_doc_charge = 0;          // reserved for search_doc in budget
+  std::atomic<bool> search_notify_queued{false};
+
+  // Library index: refreshed on library_thread, queried on the main thread.
+  std::mutex library_mu;
+  std::shared_ptr<const LibraryIndex> library; // latest complete index, null until loaded
+  size_t library_charge = 0;                   // library_mu; reserved for library in budget
+  std::thread library_thread;
+  std::atomic<bool> library_running{false};
+  std::atomic<bool> library_cancel{false};
+  std::atomic<int> library_left{0};            // documents still to index in this refresh
+  LibraryDialog* library_dialog = nullptr;     // query dialog, while open
+
+  std::mutex catalog_mu;
+  std::map<std::string, SetlistInfo> catalog;  // by file name
+  size_t catalog_charge = 0;                   // catalog_mu; reserved for catalog in budget
+  bool catalog_ready = false;
+  std::thread catalog_thread;
+  bool catalog_running = false;                // catalog_mu
+  bool catalog_again = false;                  // catalog_mu; directory changed during a scan
+  std::atomic<bool> catalog_cancel{false};
+  GFileMonitor* catalog_monitor = nullptr;
+  guint catalog_refresh_timer = 0;
+  GtkListStore* manage_store = nullptr;        // Manage Setlists, while open
+  std::shared_ptr<SetlistValidation> setlist_validation; // setlist dialog, while open
+  std::list<std::pair<std::thread, std::shared_ptr<SetlistValidation>>> validation_threads; // joined by setlist_validation_reap_cb, or at exit
+  GtkListStore* setlist_store = nullptr;
+  GtkWidget* manage_view = nullptr;
+
+  // Overview (o): scrollable grid of page thumbnails; overview_sel is the highlighted page.
+  bool overview = false;
+  int overview_sel = 0;
+  std::string stats_file; // written on exit when set
+
+  // Setlist playback: the setlist is paged through as one document.
+  std::vector<std::string> play_items;
+  int play_index = -1;                 // item on screen, -1 when not playing
+  PendingLoad* play_preload = nullptr; // next item, opened and rendered in the background
+  bool last_draw_complete = false; // every visible page drawn at its exact scale
+
+  bool batch = false;    // --bench: messages go to stderr instead of dialogs
 };
 
 static inline int clampi(int v, int lo, int hi) { return std::max(lo, std::min(v, hi)); }
@@ -113,6 +682,28 @@ static inline void update_zoom_percent(AppState* s) {
   s->zoom_percent = (int)std::lround(s->zoom * 100.0);
 }
 
+static double histogram_bucket_upper(int i) { return 0.05 * std::pow(2.0, (i + 1) / 4.0); }
+
+static void histogram_add(Histogram& h, double ms) {
+  const int i = (ms <= 0.05) ? 0 : clampi((int)std::floor(std::log2(ms / 0.05) * 4.0), 0, Histogram::BUCKETS - 1);
+  h.counts[i]++;
+  h.n++;
+  h.sum_ms += ms;
+  h.max_ms = std::max(h.max_ms, ms);
+}
+
+// Upper bound of the bucket holding the p-th percentile (p in 0..1).
+static double histogram_percentile(const Histogram& h, double p) {
+  if (h.n == 0) return 0.0;
+  const uint64_t target = std::max<uint64_t>(1, (uint64_t)std::ceil(p * (double)h.n));
+  uint64_t seen = 0;
+  for (int i = 0; i < Histogram::BUCKETS; ++i) {
+    seen += h.counts[i];
+    if (seen >= target) return std::min(histogram_bucket_upper(i), h.max_ms);
+  }
+  return h.max_ms;
+}
+
 static void update_status_label(AppState* s) {
   if (!s || !s->status_label || !GTK_IS_LABEL(s->status_label)) return;
 
@@ -133,6 +724,21 @@ static void update_status_label(AppState* s) {
     text = "Page " + std::to_string(page + 1) +
            " / " + std::to_string(s->n_pages) + " | Zoom " + std::to_string(s->zoom_percent) + "%";
   }
+  if (s->overview && s->doc)
+    text = "Overview | Page " + std::to_string(s->overview_sel + 1) + " / " + std::to_string(s->n_pages);
+  if (s->play_index >= 0)
+    text = "Setlist " + std::to_string(s->play_index + 1) + "/" + std::to_string(s->play_items.size()) + " | " + text;
+  if (s->search) {
+    std::lock_guard<std::mutex> lock(s->search->mu);
+    std::string found = "Search \"" + s->search->query + "\": " + std::to_string(s->search->hits.size()) + " page(s)";
+    if (s->search->scanned < s->search->n_pages)
+      found += " (" + std::to_string(s->search->scanned * 100 / std::max(1, s->search->n_pages)) + "%)";
+    text = found + " | " + text;
+  }
+  if (s->extracting)
+    text = (s->extracting->cancelled.load() ? std::string("Cancelling extraction...")
+                                            : "Extracting " + std::to_string(s->extracting->percent.load()) + "% (Esc: cancel)") + " | " + text;
+  if (s->loading) text = "Loading " + basename_only(s->loading->path) + "... (Esc: cancel) | " + text;
 
   gtk_label_set_text(GTK_LABEL(s->status_label), text.c_str());
 }
@@ -202,12 +808,19 @@ static void queue_redraw(AppState* s) {
     gtk_widget_queue_draw(s->drawing);
 }
 
+// Overlay-only change (timers, HUD toggle, loading badge): invalidates just the
+// corners the overlay layer paints (draw_hud at the top-left, draw_loading_badge
+// at the bottom), so the pages underneath are only re-blitted there.
+static void queue_overlay_redraw(AppState* s);
+
 static void on_main_window_destroy(GtkWidget*, gpointer user_data) {
   AppState* s = (AppState*)user_data;
   if (s) {
     s->window = nullptr;
     s->scrolled = nullptr;
     s->drawing = nullptr;
+    s->overlay_area = nullptr;
+    s->search_entry = nullptr;
   }
   gtk_main_quit();
 }
@@ -244,7 +857,7 @@ static gboolean zoom_overlay_timeout_cb(gpointer user_data) {
   if (!s) return G_SOURCE_REMOVE;
   s->zoom_overlay = false;
   s->zoom_overlay_timer = 0;
-  queue_redraw(s);
+  queue_overlay_redraw(s);
   return G_SOURCE_REMOVE;
 }
 
@@ -258,7 +871,7 @@ static void trigger_zoom_overlay(AppState* s) {
     s->zoom_overlay_timer = 0;
   }
   s->zoom_overlay_timer = g_timeout_add(900, zoom_overlay_timeout_cb, s);
-  queue_redraw(s);
+  queue_overlay_redraw(s);
 }
 
 
@@ -267,7 +880,7 @@ static gboolean page_overlay_timeout_cb(gpointer user_data) {
   if (!s) return G_SOURCE_REMOVE;
   s->page_overlay = false;
   s->page_overlay_timer = 0;
-  queue_redraw(s);
+  queue_overlay_redraw(s);
   return G_SOURCE_REMOVE;
 }
 
@@ -293,7 +906,7 @@ static void trigger_page_overlay(AppState* s) {
     s->page_overlay_timer = 0;
   }
   s->page_overlay_timer = g_timeout_add(900, page_overlay_timeout_cb, s);
-  queue_redraw(s);
+  queue_overlay_redraw(s);
 }
 
 // viewport size (visible area of scrolled window)
@@ -311,6 +924,19 @@ static void get_viewport_size(AppState* s, int& vw, int& vh) {
   }
 }
 
+// visible rectangle of the drawing area, in drawing area coordinates
+static void get_viewport_rect(AppState* s, GdkRectangle& r) {
+  int vw, vh;
+  get_viewport_size(s, vw, vh);
+  r.x = 0; r.y = 0; r.width = vw; r.height = vh;
+  if (!s || !s->scrolled) return;
+
+  GtkAdjustment* hadj = gtk_scrolled_window_get_hadjustment(GTK_SCROLLED_WINDOW(s->scrolled));
+  GtkAdjustment* vadj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(s->scrolled));
+  if (hadj) r.x = (int)gtk_adjustment_get_value(hadj);
+  if (vadj) r.y = (int)gtk_adjustment_get_value(vadj);
+}
+
 static void center_view(AppState* s) {
   if (!s || !s->scrolled) return;
   GtkAdjustment* hadj = gtk_scrolled_window_get_hadjustment(GTK_SCROLLED_WINDOW(s->scrolled));
@@ -333,66 +959,148 @@ static void center_view(AppState* s) {
   gtk_adjustment_set_value(vadj, target_y);
 }
 
-static void compute_content_size(AppState* s) {
-  if (!s || !s->doc || s->n_pages <= 0) return;
-
-  int VW, VH;
-  get_viewport_size(s, VW, VH);
+static const int PAGE_MARGIN = 12; // around the spread
+static const int PAGE_GAP = 12;    // between the two pages of a spread
 
-  const int margin = 12;
-  const int gap = 12;
+// Scale that fits one page (or a side-by-side pair when has_right) into the viewport.
+static double fit_scale(double lw, double lh, double rw, double rh, bool has_right, int VW, int VH) {
+  const int margin = PAGE_MARGIN;
+  const int gap = PAGE_GAP;
 
-  int left_idx = clampi(s->current_left, 0, s->n_pages - 1);
-  int right_idx = (s->two_pages && left_idx + 1 < s->n_pages) ? left_idx + 1 : -1;
+  if (!has_right) {
+    const double availW = std::max(1.0, (double)VW - 2.0 * margin);
+    const double availH = std::max(1.0, (double)VH - 2.0 * margin);
+    return std::min(availW / lw, availH / lh);
+  }
 
-  PopplerPage* left = poppler_document_get_page(s->doc, left_idx);
-  if (!left) return;
+  const double availW = std::max(1.0, (double)VW - 2.0 * margin - gap);
+  const double availH = std::max(1.0, (double)VH - 2.0 * margin);
+  const double scaleH_left = availH / lh;
+  const double scaleH_right = availH / rh;
+  double scaleFit = std::min(scaleH_left, scaleH_right);
 
-  PopplerPage* right = (right_idx >= 0) ? poppler_document_get_page(s->doc, right_idx) : nullptr;
+  const double totalW_at_scale = (lw * scaleFit) + gap + (rw * scaleFit);
+  if (totalW_at_scale > availW) {
+    scaleFit = availW / (lw + rw);
+    scaleFit = std::min(scaleFit, std::min(scaleH_left, scaleH_right));
+  }
+  return scaleFit;
+}
 
-  double lw=0, lh=0;
-  poppler_page_get_size(left, &lw, &lh);
+static PageSize page_size(AppState* s, int idx) {
+  if (idx < 0 || idx >= (int)s->page_sizes.size()) return PageSize{ 612.0, 792.0 };
+  return s->page_sizes[idx];
+}
 
-  double rw=0, rh=0;
-  if (right) poppler_page_get_size(right, &rw, &rh);
+// Effective scale of the spread starting at left_idx (right_idx < 0 = single page).
+static double spread_scale(AppState* s, int left_idx, int right_idx, int VW, int VH) {
+  const PageSize l = page_size(s, left_idx);
+  const PageSize r = (right_idx >= 0) ? page_size(s, right_idx) : PageSize{};
+  return fit_scale(l.w, l.h, r.w, r.h, right_idx >= 0, VW, VH) * s->zoom;
+}
 
-  double scaleFit = 1.0;
+// Layout of the current spread, cached until the page, zoom, mode or viewport changes.
+static const Layout& current_layout(AppState* s) {
+  Layout& L = s->layout;
 
-  if (!s->two_pages || !right) {
-    const double availW = std::max(1.0, (double)VW - 2.0 * margin);
-    const double availH = std::max(1.0, (double)VH - 2.0 * margin);
-    scaleFit = std::min(availW / lw, availH / lh);
+  int VW, VH;
+  get_viewport_size(s, VW, VH);
+  const int left_idx = clampi(s->current_left, 0, std::max(0, s->n_pages - 1));
+
+  if (L.valid && L.doc_id == s->render.doc_id && L.left == left_idx && L.two_pages == s->two_pages &&
+      L.zoom == s->zoom && L.VW == VW && L.VH == VH)
+    return L;
+
+  L.valid = true;
+  L.doc_id = s->render.doc_id;
+  L.left = left_idx;
+  L.two_pages = s->two_pages;
+  L.zoom = s->zoom;
+  L.VW = VW;
+  L.VH = VH;
+
+  const int right_idx = (s->two_pages && left_idx + 1 < s->n_pages) ? left_idx + 1 : -1;
+  const PageSize l = page_size(s, left_idx);
+  const PageSize r = (right_idx >= 0) ? page_size(s, right_idx) : PageSize{};
+
+  const double scale = spread_scale(s, left_idx, right_idx, VW, VH);
+  L.scale = scale;
+  L.n_slots = 0;
+
+  if (right_idx < 0) {
+    const double drawW = l.w * scale;
+    const double drawH = l.h * scale;
+    L.contentW = 2.0 * PAGE_MARGIN + drawW;
+    L.contentH = 2.0 * PAGE_MARGIN + drawH;
+    L.slots[L.n_slots++] = { left_idx, (double)PAGE_MARGIN, (double)PAGE_MARGIN, drawW, drawH };
   } else {
-    const double availW = std::max(1.0, (double)VW - 2.0 * margin - gap);
-    const double availH = std::max(1.0, (double)VH - 2.0 * margin);
-    const double scaleH_left = availH / lh;
-    const double scaleH_right = availH / rh;
-    scaleFit = std::min(scaleH_left, scaleH_right);
+    const double drawLW = l.w * scale;
+    const double drawLH = l.h * scale;
+    const double drawRW = r.w * scale;
+    const double drawRH = r.h * scale;
+    const double maxDrawH = std::max(drawLH, drawRH);
 
-    const double totalW_at_scale = (lw * scaleFit) + gap + (rw * scaleFit);
-    if (totalW_at_scale > availW) {
-      scaleFit = availW / (lw + rw);
-      scaleFit = std::min(scaleFit, std::min(scaleH_left, scaleH_right));
-    }
+    L.contentW = 2.0 * PAGE_MARGIN + drawLW + PAGE_GAP + drawRW;
+    L.contentH = 2.0 * PAGE_MARGIN + maxDrawH;
+    L.slots[L.n_slots++] = { left_idx, (double)PAGE_MARGIN, PAGE_MARGIN + (maxDrawH - drawLH) / 2.0, drawLW, drawLH };
+    L.slots[L.n_slots++] = { right_idx, PAGE_MARGIN + drawLW + PAGE_GAP, PAGE_MARGIN + (maxDrawH - drawRH) / 2.0, drawRW, drawRH };
   }
+  return L;
+}
 
-  const double scale = scaleFit * s->zoom;
+// ===== Overview grid geometry: fixed-size cells, as many columns as fit the viewport.
+static const int THUMB_W = 150;     // thumbnail box, pages are fitted inside
+static const int THUMB_H = 200;
+static const int THUMB_LABEL = 18;  // page number under the thumbnail
+static const int THUMB_GAP = 16;
+
+struct OverviewGrid {
+  int cols = 1;
+  int rows = 0;
+  int cell_w = THUMB_W + THUMB_GAP;
+  int cell_h = THUMB_H + THUMB_LABEL + THUMB_GAP;
+  double x0 = 0; // left edge of the first column
+};
 
-  double contentW = 0, contentH = 0;
-  if (!s->two_pages || !right) {
-    contentW = 2.0 * margin + lw * scale;
-    contentH = 2.0 * margin + lh * scale;
-  } else {
-    contentW = 2.0 * margin + (lw * scale) + gap + (rw * scale);
-    contentH = 2.0 * margin + std::max(lh * scale, rh * scale);
-  }
+static OverviewGrid overview_grid(AppState* s) {
+  OverviewGrid g;
+  int VW, VH;
+  get_viewport_size(s, VW, VH);
+  g.cols = std::max(1, (VW - THUMB_GAP) / g.cell_w);
+  g.rows = (s->n_pages + g.cols - 1) / g.cols;
+  g.x0 = std::max(0.0, (VW - (double)g.cols * g.cell_w - THUMB_GAP) / 2.0) + THUMB_GAP;
+  return g;
+}
+
+// Thumbnail of page idx, centered in its cell; scale maps PDF points to pixels.
+static PageSlot overview_cell_slot(AppState* s, const OverviewGrid& g, int idx, double& scale) {
+  const PageSize ps = page_size(s, idx);
+  scale = std::min(THUMB_W / ps.w, THUMB_H / ps.h);
+  const double w = std::floor(ps.w * scale), h = std::floor(ps.h * scale);
+  const double cx = g.x0 + (idx % g.cols) * g.cell_w;
+  const double cy = THUMB_GAP + (idx / g.cols) * g.cell_h;
+  return PageSlot{ idx, cx + (THUMB_W - w) / 2.0, cy + (THUMB_H - h), w, h };
+}
 
-  if (right) g_object_unref(right);
-  g_object_unref(left);
+static void compute_content_size(AppState* s) {
+  if (!s || !s->doc || s->n_pages <= 0) return;
 
-  s->contentW = std::max(VW, (int)std::ceil(contentW));
-  s->contentH = std::max(VH, (int)std::ceil(contentH));
+  int contentW, contentH;
+  if (s->overview) {
+    int VW, VH;
+    get_viewport_size(s, VW, VH);
+    const OverviewGrid g = overview_grid(s);
+    contentW = VW;
+    contentH = std::max(VH, g.rows * g.cell_h + THUMB_GAP);
+  } else {
+    const Layout& L = current_layout(s);
+    contentW = std::max(L.VW, (int)std::ceil(L.contentW));
+    contentH = std::max(L.VH, (int)std::ceil(L.contentH));
+  }
+  if (contentW == s->contentW && contentH == s->contentH) return;
 
+  s->contentW = contentW;
+  s->contentH = contentH;
   gtk_widget_set_size_request(s->drawing, s->contentW, s->contentH);
 }
 
@@ -406,21 +1114,89 @@ static void goto_left_page(AppState* s, int left0) {
   queue_redraw(s);
 }
 
+// ===== Overview (o): the grid replaces the spread in the same drawing area.
+// Scrolling waits for the new content size to be allocated (idle runs after resize).
+static gboolean overview_scroll_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s || !s->scrolled) return G_SOURCE_REMOVE;
+  if (!s->overview) {
+    center_view(s);
+    queue_redraw(s);
+    return G_SOURCE_REMOVE;
+  }
+
+  GtkAdjustment* vadj = gtk_scrolled_window_get_vadjustment(GTK_SCROLLED_WINDOW(s->scrolled));
+  if (!vadj) return G_SOURCE_REMOVE;
+  const OverviewGrid g = overview_grid(s);
+  const double top = (s->overview_sel / g.cols) * g.cell_h;
+  const double bottom = top + g.cell_h + THUMB_GAP;
+  const double v = gtk_adjustment_get_value(vadj);
+  const double page = gtk_adjustment_get_page_size(vadj);
+  if (top < v) gtk_adjustment_set_value(vadj, top);
+  else if (bottom > v + page) gtk_adjustment_set_value(vadj, bottom - page);
+  queue_redraw(s);
+  return G_SOURCE_REMOVE;
+}
+
+static void set_overview(AppState* s, bool on) {
+  if (!s || !s->doc || s->overview == on) return;
+  s->overview = on;
+  s->overview_sel = s->current_left;
+  s->layout.valid = false;
+  compute_content_size(s);
+  update_status_label(s);
+  g_idle_add(overview_scroll_cb, s);
+}
+
+static void overview_select(AppState* s, int idx) {
+  s->overview_sel = clampi(idx, 0, std::max(0, s->n_pages - 1));
+  update_status_label(s);
+  g_idle_add(overview_scroll_cb, s);
+}
+
+static void overview_activate(AppState* s, int idx) {
+  set_overview(s, false);
+  goto_left_page(s, idx);
+}
+
+static bool setlist_play_step(AppState* s, int dir);
+
+// During setlist playback, paging past either end continues in the next/previous piece.
 static void next_page(AppState* s) {
   int t = s->current_left + 1;
   if (t >= s->n_pages) t = s->n_pages - 1;
+  const int before = s->current_left;
   goto_left_page(s, t);
+  if (s->current_left == before && s->play_index >= 0) setlist_play_step(s, +1);
 }
 
 static void prev_page(AppState* s) {
   int t = s->current_left - 1;
   if (t < 0) t = 0;
+  const int before = s->current_left;
   goto_left_page(s, t);
+  if (s->current_left == before && s->play_index >= 0) setlist_play_step(s, -1);
+}
+
+static gboolean zoom_settle_timeout_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s) return G_SOURCE_REMOVE;
+  s->zoom_settle_timer = 0;
+  queue_redraw(s);
+  return G_SOURCE_REMOVE;
+}
+
+static void note_zoom_change(AppState* s) {
+  const guint settle_ms = 150;
+  s->zoom_settle_until = g_get_monotonic_time() + (gint64)settle_ms * 1000;
+  if (s->zoom_settle_timer) g_source_remove(s->zoom_settle_timer);
+  s->zoom_settle_timer = g_timeout_add(settle_ms + 10, zoom_settle_timeout_cb, s);
 }
 
 static void zoom_in(AppState* s)  {
   s->zoom = clampd(s->zoom * 1.10, 0.30, 5.00);
   update_zoom_percent(s);
+  note_zoom_change(s);
   trigger_zoom_overlay(s);
   compute_content_size(s);
   update_status_label(s);
@@ -430,6 +1206,7 @@ static void zoom_in(AppState* s)  {
 static void zoom_out(AppState* s) {
   s->zoom = clampd(s->zoom / 1.10, 0.30, 5.00);
   update_zoom_percent(s);
+  note_zoom_change(s);
   trigger_zoom_overlay(s);
   compute_content_size(s);
   update_status_label(s);
@@ -439,6 +1216,7 @@ static void zoom_out(AppState* s) {
 static void zoom_reset(AppState* s){
   s->zoom = 1.0;
   update_zoom_percent(s);
+  note_zoom_change(s);
   trigger_zoom_overlay(s);
   compute_content_size(s);
   update_status_label(s);
@@ -547,6 +1325,10 @@ static bool ask_int(AppState* s, const char* title, const char* label_txt, int&
 }
 
 static void info_box(AppState* s, const std::string& msg) {
+  if (s->batch) {
+    g_printerr("%s\n", msg.c_str());
+    return;
+  }
   GtkWidget* d = gtk_message_dialog_new(
       GTK_WINDOW(s->window),
       (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
@@ -567,8 +1349,9 @@ static void info_box(AppState* s, const std::string& msg) {
 }
 
 // ===== Extract (E)
-static std::string default_extract_name(const std::string& in_abs, int p1, int p2) {
-  char* base = g_path_get_basename(in_abs.c_str()); // ex: Meditation.pdf
+// File name without a trailing .pdf (any case).
+static std::string pdf_stem(const std::string& path) {
+  char* base = g_path_get_basename(path.c_str()); // ex: Meditation.pdf
   std::string b(base ? base : "score.pdf");
   if (base) g_free(base);
 
@@ -577,7 +1360,11 @@ static std::string default_extract_name(const std::string& in_abs, int p1, int p
     for (auto& c : tail) c = (char)tolower(c);
     if (tail == ".pdf") b = b.substr(0, b.size() - 4);
   }
-  return b + "_p" + std::to_string(p1) + "-p" + std::to_string(p2) + ".pdf";
+  return b;
+}
+
+static std::string default_extract_name(const std::string& in_abs, int p1, int p2) {
+  return pdf_stem(in_abs) + "_p" + std::to_string(p1) + "-p" + std::to_string(p2) + ".pdf";
 }
 
 static bool choose_save_path(AppState* s, const std::string& default_dir, const std::string& default_name, std::string& out_path) {
@@ -619,68 +1406,285 @@ static bool choose_save_path(AppState* s, const std::string& default_dir, const
   return ok;
 }
 
-static bool run_qpdf_extract(AppState* s, const std::string& in_abs, int page_from_1, int page_to_1, const std::string& out_abs) {
-  if (out_abs == in_abs) {
-    info_box(s, "Refus: impossible d'écraser le fichier source.");
-    return false;
-  }
+// Folder for one-file-per-range extraction (the file names are derived from a prefix).
+static bool choose_extract_folder(AppState* s, const std::string& default_dir, std::string& out_dir) {
+  GtkWidget* dlg = gtk_file_chooser_dialog_new(
+      "Dossier de l'extraction",
+      GTK_WINDOW(s->window),
+      GTK_FILE_CHOOSER_ACTION_SELECT_FOLDER,
+      "_Annuler", GTK_RESPONSE_CANCEL,
+      "_Choisir", GTK_RESPONSE_ACCEPT,
+      nullptr);
 
-  try {
-    namespace fs = std::filesystem;
+  g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
+  gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dlg), default_dir.c_str());
 
-    fs::path source_path = fs::absolute(in_abs);
-    fs::path output_path = fs::absolute(out_abs);
+  dialog_begin(s, dlg);
+  int resp = gtk_dialog_run(GTK_DIALOG(dlg));
+  dialog_end(s);
 
-    fs::path source_canon = fs::weakly_canonical(source_path);
-    fs::path output_canon;
-    if (fs::exists(output_path)) {
-      output_canon = fs::weakly_canonical(output_path);
-    } else {
-      output_canon = output_path.lexically_normal();
+  bool ok = false;
+  if (resp == GTK_RESPONSE_ACCEPT) {
+    char* fn = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
+    if (fn) {
+      out_dir = fn;
+      g_free(fn);
+      ok = true;
     }
+  }
+  gtk_widget_destroy(dlg);
+  return ok;
+}
 
-    if (source_canon == output_canon) {
-      info_box(s, "Refus: impossible d'écraser le fichier source.");
-      return false;
-    }
+// One question for every existing file an extraction would replace.
+static bool confirm_overwrite(AppState* s, const std::vector<std::string>& paths) {
+  std::string msg = (paths.size() > 1 ? "Ces fichiers existent déjà et seront remplacés:" : "Ce fichier existe déjà et sera remplacé:");
+  const size_t shown = std::min<size_t>(paths.size(), 12);
+  for (size_t i = 0; i < shown; ++i) msg += "\n" + basename_only(paths[i]);
+  if (paths.size() > shown) msg += "\n... (" + std::to_string(paths.size() - shown) + " de plus)";
+
+  GtkWidget* d = gtk_message_dialog_new(
+      GTK_WINDOW(s->window),
+      (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
+      GTK_MESSAGE_QUESTION,
+      GTK_BUTTONS_NONE,
+      "%s", msg.c_str());
+  gtk_dialog_add_button(GTK_DIALOG(d), "_Annuler", GTK_RESPONSE_CANCEL);
+  gtk_dialog_add_button(GTK_DIALOG(d), "_Remplacer", GTK_RESPONSE_OK);
+  g_signal_connect(d, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
+
+  dialog_begin(s, d);
+  int resp = gtk_dialog_run(GTK_DIALOG(d));
+  dialog_end(s);
+  gtk_widget_destroy(d);
+  return resp == GTK_RESPONSE_OK;
+}
+
+static bool refuse_overwrite_source(const std::string& in_abs, const std::string& out_abs) {
+  namespace fs = std::filesystem;
+  if (out_abs == in_abs) return true;
+  fs::path source_canon = fs::weakly_canonical(fs::absolute(in_abs));
+  fs::path output_path = fs::absolute(out_abs);
+  fs::path output_canon = fs::exists(output_path) ? fs::weakly_canonical(output_path) : output_path.lexically_normal();
+  return source_canon == output_canon;
+}
+
+// The source is parsed once per open document; every output copies its pages
+// from that one QPDF instance.
+struct ExtractCancelled {};
+
+static gboolean extract_progress_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  s->extract_notify_queued = false;
+  update_status_label(s);
+  queue_overlay_redraw(s);
+  return G_SOURCE_REMOVE;
+}
+
+// Called by QPDFWriter while it writes output `index`; also where a cancel takes effect.
+class ExtractProgress : public QPDFWriter::ProgressReporter {
+ public:
+  ExtractProgress(ExtractJob* job, int index) : job_(job), index_(index) {}
+  void reportProgress(int percent) override {
+    if (job_->cancelled.load()) throw ExtractCancelled();
+    const int n = (int)job_->outputs.size();
+    const int total = (index_ * 100 + clampi(percent, 0, 100)) / std::max(1, n);
+    if (job_->percent.exchange(total) != total && job_->s && !job_->s->extract_notify_queued.exchange(true))
+      g_idle_add(extract_progress_cb, job_->s);
+  }
 
-    QPDF pdf;
-    pdf.processFile(source_path.string().c_str());
+ private:
+  ExtractJob* job_;
+  int index_;
+};
+
+// Worker side: parses the source if it is not cached yet and writes every output from
+// it. No GTK calls; the result is left in job->ok / job->message.
+static void extract_run(ExtractJob* job) {
+  std::string written;
+  std::string partial; // output being written
+  try {
+    if (!job->src) {
+      auto parsed = std::make_unique<QPDF>();
+      parsed->processFile(std::filesystem::absolute(job->in_abs).string().c_str());
+      job->src = std::move(parsed);
+    }
+    if (job->cancelled.load()) throw ExtractCancelled();
 
-    QPDFPageDocumentHelper src_dh(pdf);
+    QPDFPageDocumentHelper src_dh(*job->src);
     auto all_pages = src_dh.getAllPages();
     int n_pages = (int)all_pages.size();
 
-    if (page_from_1 < 1 || page_to_1 < 1 || page_to_1 < page_from_1 ||
-        page_from_1 > n_pages || page_to_1 > n_pages) {
-      info_box(s, "Extraction échouée.\nPages hors limites.");
-      return false;
+    for (const auto& o : job->outputs) {
+      for (const auto& r : o.ranges) {
+        if (r.from < 1 || r.to < r.from || r.to > n_pages) {
+          job->message = "Extraction échouée.\nPages hors limites.";
+          return;
+        }
+      }
     }
 
-    QPDF out_pdf;
-    out_pdf.emptyPDF();
+    for (size_t k = 0; k < job->outputs.size(); ++k) {
+      const ExtractOutput& o = job->outputs[k];
+      QPDF out_pdf;
+      out_pdf.emptyPDF();
 
-    QPDFPageDocumentHelper out_dh(out_pdf);
-    for (int i = page_from_1 - 1; i <= page_to_1 - 1; ++i) {
-      out_dh.addPage(all_pages[i], false);
-    }
+      QPDFPageDocumentHelper out_dh(out_pdf);
+      for (const auto& r : o.ranges) {
+        for (int i = r.from - 1; i <= r.to - 1; ++i) {
+          if (job->cancelled.load()) throw ExtractCancelled();
+          out_dh.addPage(all_pages[i], false);
+        }
+      }
 
-    QPDFWriter writer(out_pdf, output_path.string().c_str());
-    writer.write();
+      const std::string output_path = std::filesystem::absolute(o.out_abs).string();
+      partial = output_path;
+      QPDFWriter writer(out_pdf, output_path.c_str());
+      writer.registerProgressReporter(std::make_shared<ExtractProgress>(job, (int)k));
+      writer.write();
+      partial.clear();
+      written += "\n" + output_path;
+    }
 
-    info_box(s, "PDF extrait enregistré:\n" + output_path.string());
-    return true;
+    job->ok = true;
+    job->message = (job->outputs.size() > 1 ? "PDF extraits enregistrés:" : "PDF extrait enregistré:") + written;
+  } catch (const ExtractCancelled&) {
+    job->message.clear();
   } catch (const std::exception& e) {
-    info_box(s, std::string("Extraction échouée.\n") + e.what());
-    return false;
+    job->message = std::string("Extraction échouée.\n") + e.what() + (written.empty() ? "" : "\nDéjà enregistrés:" + written);
+  }
+  if (!partial.empty()) {
+    std::error_code ec;
+    std::filesystem::remove(partial, ec);
   }
 }
 
-static void extract_pages(AppState* s) {
-  if (!s || !s->window || s->n_pages <= 0) return;
+// The parsed source is charged to the budget while AppState holds it.
+static void extract_src_keep(AppState* s, std::unique_ptr<QPDF> src) {
+  s->budget.reserved -= s->extract_src_charge;
+  std::error_code ec;
+  const uintmax_t size = std::filesystem::file_size(s->input_pdf_abs, ec);
+  s->extract_src_charge = ec ? 0 : (size_t)size; // QPDF keeps every object it has parsed: about the file
+  s->budget.reserved += s->extract_src_charge;
+  s->extract_src = std::move(src);
+}
 
-  GtkWidget* dialog = gtk_dialog_new_with_buttons(
-      "Extraction PDF",
+static void extract_src_take(AppState* s, std::unique_ptr<QPDF>& out) {
+  out = std::move(s->extract_src);
+  s->budget.reserved -= s->extract_src_charge;
+  s->extract_src_charge = 0;
+}
+
+// Main thread. Refuses to overwrite the source; the cached QPDF of the open document
+// moves into the job.
+static ExtractJob* extract_job_new(AppState* s, const std::string& in_abs, const std::vector<ExtractOutput>& outputs) {
+  try {
+    for (const auto& o : outputs) {
+      if (refuse_overwrite_source(in_abs, o.out_abs)) {
+        info_box(s, "Refus: impossible d'écraser le fichier source.");
+        return nullptr;
+      }
+    }
+  } catch (const std::exception& e) {
+    info_box(s, std::string("Extraction échouée.\n") + e.what());
+    return nullptr;
+  }
+
+  ExtractJob* job = new ExtractJob;
+  job->s = s;
+  job->in_abs = in_abs;
+  job->doc_id = s->render.doc_id;
+  job->outputs = outputs;
+  if (in_abs == s->input_pdf_abs) extract_src_take(s, job->src);
+  return job;
+}
+
+// Main thread: gives the parsed source back if its document is still open, reports, frees.
+static bool extract_job_finish(AppState* s, ExtractJob* job) {
+  if (!s->extract_src && job->src && job->in_abs == s->input_pdf_abs && job->doc_id == s->render.doc_id)
+    extract_src_keep(s, std::move(job->src));
+  const bool ok = job->ok;
+  if (!job->message.empty()) info_box(s, job->message);
+  delete job;
+  return ok;
+}
+
+static gboolean extract_done_cb(gpointer user_data) {
+  ExtractJob* job = (ExtractJob*)user_data;
+  AppState* s = job->s;
+  if (s->extracting == job) s->extracting = nullptr;
+  update_status_label(s);
+  queue_overlay_redraw(s);
+  s->extract_last_ok = extract_job_finish(s, job);
+  return G_SOURCE_REMOVE;
+}
+
+// Extraction in the background: the viewer stays usable, a badge shows the progress
+// and Esc cancels.
+static void extract_start(AppState* s, const std::string& in_abs, const std::vector<ExtractOutput>& outputs) {
+  if (s->extracting) {
+    info_box(s, "Une extraction est déjà en cours.");
+    return;
+  }
+  ExtractJob* job = extract_job_new(s, in_abs, outputs);
+  if (!job) return;
+  if (s->extract_thread.joinable()) s->extract_thread.join(); // the previous one has finished
+  s->extracting = job;
+  s->extract_thread = std::thread([job] {
+    extract_run(job);
+    g_idle_add(extract_done_cb, job);
+  });
+  update_status_label(s);
+  queue_overlay_redraw(s);
+}
+
+static void cancel_extraction(AppState* s) {
+  if (!s->extracting) return;
+  s->extracting->cancelled = true; // reported by extract_done_cb
+  update_status_label(s);
+  queue_overlay_redraw(s);
+}
+
+// "1-3,7,10-14" (spaces ignored, ';' also separates). Empty on a syntax error.
+static std::vector<PageRange> parse_page_ranges(std::string spec) {
+  spec.erase(std::remove_if(spec.begin(), spec.end(), [](unsigned char c){ return std::isspace(c); }), spec.end());
+  std::replace(spec.begin(), spec.end(), ';', ',');
+  std::vector<PageRange> ranges;
+  std::stringstream ss(spec);
+  std::string part;
+  while (std::getline(ss, part, ',')) {
+    if (part.empty()) continue;
+    size_t dash = part.find('-');
+    try {
+      size_t used = 0;
+      PageRange r;
+      if (dash == std::string::npos) {
+        r.from = r.to = std::stoi(part, &used);
+        if (used != part.size()) return {};
+      } else {
+        const std::string a = part.substr(0, dash), b = part.substr(dash + 1);
+        r.from = std::stoi(a, &used);
+        if (used != a.size()) return {};
+        r.to = std::stoi(b, &used);
+        if (used != b.size()) return {};
+      }
+      ranges.push_back(r);
+    } catch (...) {
+      return {};
+    }
+  }
+  return ranges;
+}
+
+static void on_toggle_sensitive(GtkToggleButton* button, gpointer widget) {
+  gtk_widget_set_sensitive(GTK_WIDGET(widget), gtk_toggle_button_get_active(button));
+}
+
+static void extract_pages(AppState* s) {
+  if (!s || !s->window || s->n_pages <= 0) return;
+
+  GtkWidget* dialog = gtk_dialog_new_with_buttons(
+      "Extraction PDF",
       GTK_WINDOW(s->window),
       (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
       "_Back", GTK_RESPONSE_CANCEL,
@@ -693,13 +1697,27 @@ static void extract_pages(AppState* s) {
   gtk_container_set_border_width(GTK_CONTAINER(box), 10);
   gtk_container_add(GTK_CONTAINER(content), box);
 
-  GtkWidget* label = gtk_label_new("Page or range (examples: 7 or 10-14):");
+  GtkWidget* label = gtk_label_new("Pages or ranges (examples: 7, 10-14 or 1-3,7,10-14):");
   gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
 
   GtkWidget* entry = gtk_entry_new();
   gtk_entry_set_activates_default(GTK_ENTRY(entry), TRUE);
   gtk_box_pack_start(GTK_BOX(box), entry, FALSE, FALSE, 0);
 
+  GtkWidget* per_range = gtk_check_button_new_with_mnemonic("One _file per range");
+  gtk_box_pack_start(GTK_BOX(box), per_range, FALSE, FALSE, 0);
+
+  // Files are named <prefix>_p<from>-p<to>.pdf in a folder chosen next.
+  GtkWidget* prefix_box = gtk_box_new(GTK_ORIENTATION_HORIZONTAL, 8);
+  gtk_box_pack_start(GTK_BOX(prefix_box), gtk_label_new("File name prefix:"), FALSE, FALSE, 0);
+  GtkWidget* prefix_entry = gtk_entry_new();
+  gtk_entry_set_text(GTK_ENTRY(prefix_entry), pdf_stem(s->input_pdf_abs).c_str());
+  gtk_entry_set_activates_default(GTK_ENTRY(prefix_entry), TRUE);
+  gtk_box_pack_start(GTK_BOX(prefix_box), prefix_entry, TRUE, TRUE, 0);
+  gtk_box_pack_start(GTK_BOX(box), prefix_box, FALSE, FALSE, 0);
+  gtk_widget_set_sensitive(prefix_box, FALSE);
+  g_signal_connect(per_range, "toggled", G_CALLBACK(on_toggle_sensitive), prefix_box);
+
   gtk_dialog_set_default_response(GTK_DIALOG(dialog), GTK_RESPONSE_OK);
   gtk_widget_show_all(dialog);
 
@@ -707,54 +1725,65 @@ static void extract_pages(AppState* s) {
   int resp = gtk_dialog_run(GTK_DIALOG(dialog));
   dialog_end(s);
 
-  int p1 = 0, p2 = 0;
-  bool ok = false;
+  std::vector<PageRange> ranges;
+  const bool one_per_range = gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(per_range));
+  std::string prefix = gtk_entry_get_text(GTK_ENTRY(prefix_entry));
   if (resp == GTK_RESPONSE_OK) {
     const char* txt = gtk_entry_get_text(GTK_ENTRY(entry));
-    std::string spec = txt ? txt : "";
-    spec.erase(std::remove_if(spec.begin(), spec.end(), [](unsigned char c){ return std::isspace(c); }), spec.end());
-    if (!spec.empty()) {
-      size_t dash = spec.find('-');
-      try {
-        if (dash == std::string::npos) {
-          p1 = p2 = std::stoi(spec);
-          ok = true;
-        } else {
-          p1 = std::stoi(spec.substr(0, dash));
-          p2 = std::stoi(spec.substr(dash + 1));
-          ok = true;
-        }
-      } catch (...) {
-        ok = false;
-      }
-    }
+    ranges = parse_page_ranges(txt ? txt : "");
   }
   gtk_widget_destroy(dialog);
-  if (!ok) return;
+  if (ranges.empty()) return;
 
-  if (p1 < 1 || p2 < 1 || p1 > s->n_pages || p2 > s->n_pages) {
-    info_box(s, std::string("Pages hors limites.\nRappel: 1 <= début <= fin <= ") + std::to_string(s->n_pages));
-    return;
-  }
-  if (p2 < p1) {
-    info_box(s, "Intervalle invalide: il faut début <= fin.");
-    return;
+  for (const auto& r : ranges) {
+    if (r.from < 1 || r.to < 1 || r.from > s->n_pages || r.to > s->n_pages) {
+      info_box(s, std::string("Pages hors limites.\nRappel: 1 <= début <= fin <= ") + std::to_string(s->n_pages));
+      return;
+    }
+    if (r.to < r.from) {
+      info_box(s, "Intervalle invalide: il faut début <= fin.");
+      return;
+    }
   }
 
   char* dir = g_path_get_dirname(s->input_pdf_abs.c_str());
   std::string default_dir = dir ? dir : ".";
   if (dir) g_free(dir);
 
-  std::string default_name = default_extract_name(s->input_pdf_abs, p1, p2);
-
-  std::string out_path;
-  if (!choose_save_path(s, default_dir, default_name, out_path)) return;
-
-  if (out_path.size() < 4 || out_path.substr(out_path.size() - 4) != ".pdf") {
-    out_path += ".pdf";
+  std::vector<ExtractOutput> outputs;
+  if (one_per_range && ranges.size() > 1) {
+    prefix = trim_copy(prefix);
+    if (prefix.empty() || prefix.find('/') != std::string::npos) {
+      info_box(s, "Préfixe invalide.");
+      return;
+    }
+    std::string out_dir;
+    if (!choose_extract_folder(s, default_dir, out_dir)) return;
+
+    // The same range twice would write the same file twice.
+    std::set<std::pair<int, int>> seen;
+    std::vector<std::string> existing;
+    for (const auto& r : ranges) {
+      if (!seen.insert({ r.from, r.to }).second) continue;
+      const std::string path = out_dir + "/" + prefix + "_p" + std::to_string(r.from) + "-p" + std::to_string(r.to) + ".pdf";
+      struct stat st;
+      if (stat(path.c_str(), &st) == 0) existing.push_back(path);
+      outputs.push_back({ { r }, path });
+    }
+    if (!existing.empty() && !confirm_overwrite(s, existing)) return;
+  } else {
+    // The file chooser asks before replacing the chosen file.
+    const std::string default_name = (ranges.size() == 1) ? default_extract_name(s->input_pdf_abs, ranges[0].from, ranges[0].to)
+                                                          : pdf_stem(s->input_pdf_abs) + "_extract.pdf";
+    std::string out_path;
+    if (!choose_save_path(s, default_dir, default_name, out_path)) return;
+
+    if (out_path.size() < 4 || out_path.substr(out_path.size() - 4) != ".pdf") {
+      out_path += ".pdf";
+    }
+    outputs.push_back({ ranges, out_path });
   }
-
-  run_qpdf_extract(s, s->input_pdf_abs, p1, p2, out_path);
+  extract_start(s, s->input_pdf_abs, outputs);
 }
 
 static void show_help(AppState* s) {
@@ -790,6 +1819,12 @@ static void show_help(AppState* s) {
       "  f     : plein écran\n"
       "  g     : aller à la page\n"
       "  e     : extraire pages -> nouveau PDF\n"
+      "  o     : vue d'ensemble (miniatures)\n"
+      "  n     : affichage normal / nuit / sépia\n"
+      "  / ou Ctrl+F : rechercher (Entrée / Maj+Entrée : suivant / précédent)\n"
+      "  Ctrl+L: rechercher dans toutes les setlists\n"
+      "  i     : statistiques de rendu (HUD)\n"
+      "  Ctrl+I: enregistrer les statistiques\n"
       "  Ctrl+P: imprimer\n"
       "  Esc   : fermer le PDF / quitter";
 
@@ -815,8 +1850,16 @@ static void show_help(AppState* s) {
 
 static bool choose_open_pdf(AppState* s);
 static void print_document(AppState* s);
+static void dump_render_stats(AppState* s);
 static bool open_setlist_dialog(AppState* s);
 static void close_current_document(AppState* s);
+static void cancel_document_load(AppState* s);
+static void cancel_extraction(AppState* s);
+static void cycle_display_mode(AppState* s);
+static void open_search(AppState* s);
+static void search_stop(AppState* s);
+static void library_dialog(AppState* s);
+static void setlist_catalog_refresh(AppState* s);
 static void create_setlist_dialog(AppState* s);
 static void edit_setlist_dialog(AppState* s);
 static void rename_setlist_dialog(AppState* s);
@@ -872,6 +1915,7 @@ static void open_top_menu(AppState* s, GtkWidget* item) {
 static gboolean on_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
   AppState* s = (AppState*)user_data;
   if (!s) return FALSE;
+  if (s->search_entry && gtk_widget_has_focus(s->search_entry)) return FALSE; // typing a query
 
   const bool ctrl = (ev->state & GDK_CONTROL_MASK) != 0;
   const bool alt  = (ev->state & GDK_MOD1_MASK) != 0;
@@ -901,6 +1945,15 @@ static gboolean on_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
       case GDK_KEY_p:
       case GDK_KEY_P:
         print_document(s); return TRUE;
+      case GDK_KEY_i:
+      case GDK_KEY_I:
+        dump_render_stats(s); return TRUE;
+      case GDK_KEY_f:
+      case GDK_KEY_F:
+        open_search(s); return TRUE;
+      case GDK_KEY_l:
+      case GDK_KEY_L:
+        library_dialog(s); return TRUE;
       case GDK_KEY_plus:
       case GDK_KEY_KP_Add:
       case GDK_KEY_equal: // some layouts
@@ -915,6 +1968,33 @@ static gboolean on_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
     }
   }
 
+  // Overview grid: arrows move the highlight, Enter opens the page
+  if (s->overview) {
+    const OverviewGrid g = overview_grid(s);
+    int VW, VH;
+    get_viewport_size(s, VW, VH);
+    const int screen = std::max(1, VH / g.cell_h) * g.cols;
+    switch (ev->keyval) {
+      case GDK_KEY_Left:      overview_select(s, s->overview_sel - 1); return TRUE;
+      case GDK_KEY_Right:     overview_select(s, s->overview_sel + 1); return TRUE;
+      case GDK_KEY_Up:        overview_select(s, s->overview_sel - g.cols); return TRUE;
+      case GDK_KEY_Down:      overview_select(s, s->overview_sel + g.cols); return TRUE;
+      case GDK_KEY_Page_Up:   overview_select(s, s->overview_sel - screen); return TRUE;
+      case GDK_KEY_Page_Down: overview_select(s, s->overview_sel + screen); return TRUE;
+      case GDK_KEY_Home:      overview_select(s, 0); return TRUE;
+      case GDK_KEY_End:       overview_select(s, s->n_pages - 1); return TRUE;
+      case GDK_KEY_Return:
+      case GDK_KEY_KP_Enter:
+      case GDK_KEY_space:
+        overview_activate(s, s->overview_sel); return TRUE;
+      case GDK_KEY_Escape:
+      case GDK_KEY_o:
+      case GDK_KEY_O:
+        set_overview(s, false); return TRUE;
+      default: break;
+    }
+  }
+
   // When zoom > 1 : arrows scroll (page keys remain page nav)
   if (s->zoom > 1.000001) {
     const double step = 90.0;
@@ -929,7 +2009,16 @@ static gboolean on_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
 
   switch (ev->keyval) {
     case GDK_KEY_Escape:
-      if (s->doc) {
+      if (s->loading) {
+        void (*back)(AppState*) = s->loading->on_failure;
+        cancel_document_load(s);
+        if (back) back(s);
+      } else if (s->extracting && !s->extracting->cancelled.load()) {
+        cancel_extraction(s);
+      } else if (s->search_entry && gtk_widget_get_visible(s->search_entry)) {
+        gtk_widget_hide(s->search_entry);
+        search_stop(s);
+      } else if (s->doc) {
         close_current_document(s);
       } else {
         gtk_main_quit();
@@ -951,11 +2040,32 @@ static gboolean on_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
       goto_dialog(s);
       return TRUE;
 
+    case GDK_KEY_o:
+    case GDK_KEY_O:
+      set_overview(s, true);
+      return TRUE;
+
     case GDK_KEY_e:
     case GDK_KEY_E:
       extract_pages(s);
       return TRUE;
 
+    case GDK_KEY_n:
+    case GDK_KEY_N:
+      cycle_display_mode(s);
+      return TRUE;
+
+    case GDK_KEY_slash:
+    case GDK_KEY_KP_Divide:
+      open_search(s);
+      return TRUE;
+
+    case GDK_KEY_i:
+    case GDK_KEY_I:
+      s->show_hud = !s->show_hud;
+      queue_overlay_redraw(s);
+      return TRUE;
+
     case GDK_KEY_1:
     case GDK_KEY_KP_1:
       s->two_pages = false;
@@ -1000,234 +2110,2310 @@ static void render_page(PopplerPage* page, cairo_t* cr, double x, double y, doub
   cairo_restore(cr);
 }
 
-static gboolean on_draw(GtkWidget* widget, cairo_t* cr, gpointer user_data) {
-  AppState* s = (AppState*)user_data;
-  if (!s) return FALSE;
+// ===== Scanned pages: a page whose content stream paints one embedded image covering
+// the page and nothing else visible (no annotations, only invisible OCR text) is drawn
+// from the decoded image instead of poppler_page_render, which decodes the whole image
+// again for every render and every tile. The image is decoded once, downsampled to the
+// size it is drawn at and its successive 2x reductions are shared by all workers; only
+// the downsampled levels are charged to the memory budget, before they are made, and
+// pages that do not fit are rendered normally.
+static const size_t SCAN_IMAGES_HELD = 2; // both pages of a spread
+
+// Per-worker handle: the store and the document the worker's PopplerDocument belongs to.
+struct ScanCache {
+  ScanStore* store = nullptr;
+  unsigned doc_id = 0;
+};
 
-  GtkAllocation a;
-  gtk_widget_get_allocation(widget, &a);
-  const int W = std::max(1, a.width);
-  const int H = std::max(1, a.height);
+static void scan_image_free(ScanImage* img) {
+  for (cairo_surface_t* l : img->levels) cairo_surface_destroy(l);
+  if (img->budget) img->budget->reserved -= img->bytes;
+  delete img;
+}
 
-  cairo_save(cr);
-  cairo_set_source_rgb(cr, 0.08, 0.08, 0.08);
-  cairo_paint(cr);
-  cairo_restore(cr);
+static void scan_store_reset_locked(ScanStore* st) {
+  st->images.clear(); // freed as soon as no worker draws from them
+  st->info.clear();
+  st->pdf.reset();
+  st->pdf_failed = false;
+  if (st->doc_bytes) g_bytes_unref(st->doc_bytes);
+  st->doc_bytes = nullptr;
+}
 
-  if (!s->doc || s->n_pages <= 0) return FALSE;
+// Called by a worker that switches to document doc_id; the first one to get there
+// drops what the store holds for the previous document.
+static void scan_store_use(ScanStore* st, unsigned doc_id, GBytes* bytes) {
+  std::lock_guard<std::mutex> lock(st->mu);
+  if (doc_id <= st->doc_id) return;
+  scan_store_reset_locked(st);
+  st->doc_id = doc_id;
+  st->doc_bytes = bytes ? g_bytes_ref(bytes) : nullptr;
+}
 
-  int VW, VH;
-  get_viewport_size(s, VW, VH);
+// Accepts a content stream that paints exactly one image XObject and nothing else
+// visible: text is allowed only in render mode 3 (OCR layers), paths only when they
+// are discarded without clipping. Anything unknown rejects the page.
+class ScanContentCheck : public QPDFObjectHandle::ParserCallbacks {
+ public:
+  bool ok = true;
+  std::string image;           // name given to Do
+  double ctm[6] = {};          // when it was painted
+
+  void handleObject(QPDFObjectHandle obj) override {
+    if (!ok) return;
+    if (!obj.isOperator()) {
+      operands_.push_back(obj);
+      return;
+    }
+    operator_(obj.getOperatorValue());
+    operands_.clear();
+  }
+  void handleEOF() override {}
+
+ private:
+  struct State {
+    double ctm[6] = { 1, 0, 0, 1, 0, 0 };
+    long long tr = 0;
+  };
+  State cur_;
+  std::vector<State> saved_;
+  std::vector<QPDFObjectHandle> operands_;
+
+  void operator_(const std::string& op) {
+    static const std::set<std::string> harmless = {
+      "BT", "ET", "Tc", "Tw", "Tz", "TL", "Tf", "Ts", "Td", "TD", "Tm", "T*",
+      "g", "G", "rg", "RG", "k", "K", "cs", "CS", "sc", "SC", "scn", "SCN",
+      "w", "J", "j", "M", "d", "ri", "i", "m", "l", "c", "v", "y", "h", "re", "n",
+      "BMC", "BDC", "EMC", "MP", "DP",
+    };
+    if (op == "q") {
+      saved_.push_back(cur_);
+    } else if (op == "Q") {
+      if (!saved_.empty()) {
+        cur_ = saved_.back();
+        saved_.pop_back();
+      }
+    } else if (op == "cm") {
+      if (operands_.size() != 6) { ok = false; return; }
+      double m[6];
+      for (int i = 0; i < 6; ++i) {
+        if (!operands_[i].isNumber()) { ok = false; return; }
+        m[i] = operands_[i].getNumericValue();
+      }
+      const double* c = cur_.ctm;
+      const double r[6] = { m[0] * c[0] + m[1] * c[2], m[0] * c[1] + m[1] * c[3],
+                            m[2] * c[0] + m[3] * c[2], m[2] * c[1] + m[3] * c[3],
+                            m[4] * c[0] + m[5] * c[2] + c[4], m[4] * c[1] + m[5] * c[3] + c[5] };
+      std::copy(r, r + 6, cur_.ctm);
+    } else if (op == "Tr") {
+      if (operands_.size() != 1 || !operands_[0].isInteger()) { ok = false; return; }
+      cur_.tr = operands_[0].getIntValue();
+    } else if (op == "Tj" || op == "TJ" || op == "'" || op == "\"") {
+      if (cur_.tr != 3) ok = false;
+    } else if (op == "Do") {
+      if (!image.empty() || operands_.size() != 1 || !operands_[0].isName()) { ok = false; return; }
+      image = operands_[0].getName();
+      std::copy(cur_.ctm, cur_.ctm + 6, ctm);
+    } else if (!harmless.count(op)) {
+      ok = false;
+    }
+  }
+};
 
-  const int margin = 12;
-  const int gap = 12;
+// Content-stream side of the detection, with the store locked (QPDF is not thread-safe).
+// Returns false when the page is not a plain, upright scan.
+static bool scan_analyze_locked(ScanStore* st, int page_idx, ScanInfo& info) {
+  if (!st->pdf && !st->pdf_failed && st->doc_bytes) {
+    try {
+      gsize size = 0;
+      const char* data = (const char*)g_bytes_get_data(st->doc_bytes, &size);
+      auto pdf = std::make_unique<QPDF>();
+      pdf->setSuppressWarnings(true);
+      pdf->processMemoryFile("rdScore", data, size);
+      st->pdf = std::move(pdf);
+    } catch (const std::exception&) {
+      st->pdf_failed = true;
+    }
+  }
+  if (!st->pdf) return false;
 
-  int left_idx = clampi(s->current_left, 0, s->n_pages - 1);
-  int right_idx = (s->two_pages && left_idx + 1 < s->n_pages) ? left_idx + 1 : -1;
+  try {
+    auto pages = QPDFPageDocumentHelper(*st->pdf).getAllPages();
+    if (page_idx < 0 || page_idx >= (int)pages.size()) return false;
+    QPDFPageObjectHelper& page = pages[page_idx];
+    QPDFObjectHandle rotate = page.getAttribute("/Rotate", false);
+    if (rotate.isInteger() && rotate.getIntValue() % 360 != 0) return false;
+
+    ScanContentCheck check;
+    page.parseContents(&check);
+    if (!check.ok || check.image.empty()) return false;
+
+    auto images = page.getImages();
+    auto found = images.find(check.image);
+    if (found == images.end()) return false; // a form XObject
+    QPDFObjectHandle dict = found->second.getDict();
+    QPDFObjectHandle mask = dict.getKey("/ImageMask");
+    if ((mask.isBool() && mask.getBoolValue()) || dict.hasKey("/SMask") || dict.hasKey("/Mask")) return false;
+    QPDFObjectHandle w = dict.getKey("/Width"), h = dict.getKey("/Height");
+    if (!w.isInteger() || !h.isInteger() || w.getIntValue() <= 0 || h.getIntValue() <= 0) return false;
+
+    // Only upright placements: the unit square goes to [e, e+a] x [f, f+d].
+    const double* m = check.ctm;
+    if (m[1] != 0 || m[2] != 0 || m[0] <= 0 || m[3] <= 0) return false;
+    const QPDFObjectHandle::Rectangle crop = page.getCropBox().getArrayAsRectangle();
+    const double top = std::max(crop.lly, crop.ury), left = std::min(crop.llx, crop.urx);
+    info.area.x1 = m[4] - left;
+    info.area.x2 = m[4] + m[0] - left;
+    info.area.y1 = top - (m[5] + m[3]);
+    info.area.y2 = top - m[5];
+    info.img_w = (int)w.getIntValue();
+    info.img_h = (int)h.getIntValue();
+    return true;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
 
-  PopplerPage* left = poppler_document_get_page(s->doc, left_idx);
-  if (!left) return FALSE;
-  PopplerPage* right = (right_idx >= 0) ? poppler_document_get_page(s->doc, right_idx) : nullptr;
+static ScanInfo scan_page_info(ScanCache* sc, PopplerPage* page, int page_idx) {
+  ScanStore* st = sc->store;
+  {
+    std::lock_guard<std::mutex> lock(st->mu);
+    if (st->doc_id != sc->doc_id) return ScanInfo();
+    auto found = st->info.find(page_idx);
+    if (found != st->info.end()) return found->second;
+  }
 
-  double lw=0, lh=0;
-  poppler_page_get_size(left, &lw, &lh);
+  // Poppler side, on this worker's document: exactly one image and no annotations.
+  int image_id = -1;
+  GList* images = poppler_page_get_image_mapping(page);
+  GList* annots = poppler_page_get_annot_mapping(page);
+  if (images && !images->next && !annots) image_id = ((const PopplerImageMapping*)images->data)->image_id;
+  if (images) poppler_page_free_image_mapping(images);
+  if (annots) poppler_page_free_annot_mapping(annots);
 
-  double rw=0, rh=0;
-  if (right) poppler_page_get_size(right, &rw, &rh);
+  double pw = 0, ph = 0;
+  poppler_page_get_size(page, &pw, &ph);
 
-  double scaleFit = 1.0;
-  if (!s->two_pages || !right) {
-    const double availW = std::max(1.0, (double)VW - 2.0 * margin);
-    const double availH = std::max(1.0, (double)VH - 2.0 * margin);
-    scaleFit = std::min(availW / lw, availH / lh);
+  std::lock_guard<std::mutex> lock(st->mu);
+  if (st->doc_id != sc->doc_id) return ScanInfo();
+  ScanInfo info;
+  if (image_id >= 0 && scan_analyze_locked(st, page_idx, info) &&
+      (info.area.x2 - info.area.x1) * (info.area.y2 - info.area.y1) >= 0.9 * pw * ph) {
+    info.image_id = image_id;
   } else {
-    const double availW = std::max(1.0, (double)VW - 2.0 * margin - gap);
-    const double availH = std::max(1.0, (double)VH - 2.0 * margin);
-    const double scaleH_left = availH / lh;
-    const double scaleH_right = availH / rh;
-    scaleFit = std::min(scaleH_left, scaleH_right);
+    info = ScanInfo();
+  }
+  return st->info[page_idx] = info;
+}
+
+// Half-size copy; bilinear sampling at exactly 1/2 averages each 2x2 block.
+static cairo_surface_t* reduce_by_two(cairo_surface_t* src) {
+  const int sw = cairo_image_surface_get_width(src), sh = cairo_image_surface_get_height(src);
+  const int w = std::max(1, sw / 2), h = std::max(1, sh / 2);
+  cairo_surface_t* dst = cairo_image_surface_create(cairo_image_surface_get_format(src), w, h);
+  if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(dst);
+    return nullptr;
+  }
+  cairo_t* cr = cairo_create(dst);
+  cairo_scale(cr, (double)w / sw, (double)h / sh);
+  cairo_set_source_surface(cr, src, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(dst);
+  return dst;
+}
+
+// Copy of src at w x h; FILTER_GOOD averages over the source pixels when shrinking.
+static cairo_surface_t* scan_downsample(cairo_surface_t* src, int w, int h) {
+  const int sw = cairo_image_surface_get_width(src), sh = cairo_image_surface_get_height(src);
+  cairo_surface_t* dst = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+  if (cairo_surface_status(dst) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(dst);
+    return nullptr;
+  }
+  cairo_t* cr = cairo_create(dst);
+  cairo_scale(cr, (double)w / sw, (double)h / sh);
+  cairo_set_source_surface(cr, src, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_GOOD);
+  cairo_paint(cr);
+  cairo_destroy(cr);
+  cairo_surface_flush(dst);
+  return dst;
+}
 
-    const double totalW_at_scale = (lw * scaleFit) + gap + (rw * scaleFit);
-    if (totalW_at_scale > availW) {
-      scaleFit = availW / (lw + rw);
-      scaleFit = std::min(scaleFit, std::min(scaleH_left, scaleH_right));
+// The page image of page_idx at least target_w pixels wide (or at full resolution),
+// decoding it if no worker has one that large (outside the lock, once for all of them;
+// the others wait for it). nullptr when it does not fit the budget or the decode
+// failed: render normally.
+static std::shared_ptr<ScanImage> scan_image_get(ScanCache* sc, PopplerPage* page, int page_idx,
+                                                 const ScanInfo& info, double target_w) {
+  int shift = 0;
+  while (shift < 30 && (info.img_w >> (shift + 1)) >= std::max(1.0, target_w)) ++shift;
+  const int base_w = std::max(1, info.img_w >> shift), base_h = std::max(1, info.img_h >> shift);
+
+  ScanStore* st = sc->store;
+  std::unique_lock<std::mutex> lock(st->mu);
+  if (st->doc_id != sc->doc_id) return nullptr;
+  for (auto it = st->images.begin(); it != st->images.end(); ++it) {
+    if ((*it)->page != page_idx) continue;
+    std::shared_ptr<ScanImage> img = *it;
+    if (img->base_w < base_w) { // too coarse for this scale; workers drawing from it keep it
+      st->images.erase(it);
+      break;
     }
+    st->images.splice(st->images.begin(), st->images, it);
+    st->cv.wait(lock, [&img] { return img->ready; });
+    return img->levels.empty() ? nullptr : img;
   }
 
-  const double scale = scaleFit * s->zoom;
+  // Reserve the downsampled image before decoding, making room by dropping images no
+  // worker is drawing from.
+  const size_t bytes = (size_t)base_w * 4 * (size_t)base_h;
+  while (st->images.size() >= SCAN_IMAGES_HELD) st->images.pop_back();
+  while (st->budget && !memory_budget_try_reserve(st->budget, bytes)) {
+    auto idle = std::find_if(st->images.rbegin(), st->images.rend(),
+                             [](const std::shared_ptr<ScanImage>& i) { return i.use_count() == 1 && i->ready; });
+    if (idle == st->images.rend()) return nullptr;
+    st->images.erase(std::next(idle).base());
+  }
+  std::shared_ptr<ScanImage> img(new ScanImage, scan_image_free);
+  img->page = page_idx;
+  img->base_w = base_w;
+  img->budget = st->budget;
+  img->bytes = bytes;
+  st->images.push_front(img);
+  lock.unlock();
+
+  cairo_surface_t* decoded = poppler_page_get_image(page, info.image_id);
+  cairo_surface_t* base = nullptr;
+  if (decoded && cairo_surface_status(decoded) == CAIRO_STATUS_SUCCESS &&
+      cairo_surface_get_type(decoded) == CAIRO_SURFACE_TYPE_IMAGE &&
+      cairo_image_surface_get_width(decoded) == info.img_w &&
+      cairo_image_surface_get_height(decoded) == info.img_h) {
+    base = scan_downsample(decoded, base_w, base_h);
+  }
+  if (decoded) cairo_surface_destroy(decoded);
 
-  if (!s->two_pages || !right) {
-    const double drawW = lw * scale;
-    const double drawH = lh * scale;
+  lock.lock();
+  img->ready = true;
+  if (base) {
+    img->levels.push_back(base);
+  } else {
+    st->images.remove(img);
+    if (st->doc_id == sc->doc_id) st->info[page_idx].image_id = -1;
+  }
+  st->cv.notify_all();
+  return base ? img : nullptr;
+}
 
-    const double contentW = 2.0 * margin + drawW;
-    const double contentH = 2.0 * margin + drawH;
+// Smallest reduction of the page image that is still at least target_w pixels wide,
+// with a reference for the caller. Reductions are budgeted like the decode.
+static cairo_surface_t* scan_image_level(ScanStore* st, ScanImage* img, double target_w) {
+  std::unique_lock<std::mutex> lock(st->mu);
+  while (true) {
+    cairo_surface_t* last = img->levels.back();
+    const int w = cairo_image_surface_get_width(last), h = cairo_image_surface_get_height(last);
+    if (w < 2.0 * target_w || w < 2) break;
+    const size_t k = img->levels.size();
+    const size_t bytes = (size_t)std::max(1, w / 2) * 4 * (size_t)std::max(1, h / 2);
+    cairo_surface_reference(last);
+    lock.unlock();
+    const bool reserved = !img->budget || memory_budget_try_reserve(img->budget, bytes);
+    cairo_surface_t* reduced = reserved ? reduce_by_two(last) : nullptr;
+    if (reserved && !reduced && img->budget) img->budget->reserved -= bytes;
+    cairo_surface_destroy(last);
+    lock.lock();
+    if (!reduced) break;
+    if (img->levels.size() == k) {
+      img->levels.push_back(reduced);
+      img->bytes += bytes;
+    } else { // another worker made it meanwhile
+      cairo_surface_destroy(reduced);
+      if (img->budget) img->budget->reserved -= bytes;
+    }
+  }
+  for (size_t k = img->levels.size(); k-- > 0;) {
+    if (cairo_image_surface_get_width(img->levels[k]) >= target_w) return cairo_surface_reference(img->levels[k]);
+  }
+  return cairo_surface_reference(img->levels[0]);
+}
 
-    const double x0 = (W > contentW) ? ((W - contentW) / 2.0) : 0.0;
-    const double y0 = (H > contentH) ? ((H - contentH) / 2.0) : 0.0;
+// Draws page like render_page when it is a scan; returns false to fall back.
+static bool draw_scan_page(ScanCache* sc, PopplerPage* page, int page_idx, cairo_t* cr, double x, double y, double scale) {
+  if (!sc || !sc->store) return false;
+  const ScanInfo info = scan_page_info(sc, page, page_idx);
+  if (info.image_id < 0) return false;
+  const double aw = info.area.x2 - info.area.x1, ah = info.area.y2 - info.area.y1;
+  std::shared_ptr<ScanImage> decoded = scan_image_get(sc, page, page_idx, info, aw * scale);
+  if (!decoded) return false;
 
-    const double x = x0 + margin;
-    const double y = y0 + margin;
+  cairo_surface_t* img = scan_image_level(sc->store, decoded.get(), aw * scale);
 
-    cairo_save(cr);
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_rectangle(cr, x, y, drawW, drawH);
-    cairo_fill(cr);
-    cairo_restore(cr);
+  cairo_save(cr);
+  cairo_translate(cr, x + info.area.x1 * scale, y + info.area.y1 * scale);
+  cairo_scale(cr, aw * scale / cairo_image_surface_get_width(img), ah * scale / cairo_image_surface_get_height(img));
+  cairo_set_source_surface(cr, img, 0, 0);
+  cairo_pattern_set_filter(cairo_get_source(cr), CAIRO_FILTER_BILINEAR);
+  cairo_paint(cr);
+  cairo_restore(cr);
+  cairo_surface_destroy(img);
+  return true;
+}
 
-    render_page(left, cr, x, y, scale);
-  } else {
-    const double drawLW = lw * scale;
-    const double drawLH = lh * scale;
-    const double drawRW = rw * scale;
-    const double drawRH = rh * scale;
+// ===== Render engine
+static inline int render_scale_key(double scale) { return (int)std::lround(scale * 10000.0); }
 
-    const double totalDrawW = drawLW + gap + drawRW;
-    const double maxDrawH = std::max(drawLH, drawRH);
+static RenderJob make_render_job(AppState* s, int page_idx, double scale) {
+  RenderJob job;
+  job.key.doc_id = s->render.doc_id;
+  job.key.page = page_idx;
+  job.key.scale_key = render_scale_key(scale);
+  job.scale = scale;
+  return job;
+}
 
-    const double contentW = 2.0 * margin + totalDrawW;
-    const double contentH = 2.0 * margin + maxDrawH;
+static cairo_surface_t* rasterize_page(PopplerDocument* doc, int page_idx, double scale, ScanCache* scan = nullptr) {
+  PopplerPage* page = poppler_document_get_page(doc, page_idx);
+  if (!page) return nullptr;
 
-    const double x0 = (W > contentW) ? ((W - contentW) / 2.0) : 0.0;
-    const double y0 = (H > contentH) ? ((H - contentH) / 2.0) : 0.0;
+  double pw = 0, ph = 0;
+  poppler_page_get_size(page, &pw, &ph);
+  const int w = std::max(1, (int)std::ceil(pw * scale));
+  const int h = std::max(1, (int)std::ceil(ph * scale));
+
+  cairo_surface_t* surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+  if (cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surf);
+    g_object_unref(page);
+    return nullptr;
+  }
 
-    const double startX = x0 + margin;
-    const double yL = y0 + margin + (maxDrawH - drawLH) / 2.0;
-    const double yR = y0 + margin + (maxDrawH - drawRH) / 2.0;
+  cairo_t* cr = cairo_create(surf);
+  cairo_set_source_rgb(cr, 1, 1, 1);
+  cairo_paint(cr);
+  if (!draw_scan_page(scan, page, page_idx, cr, 0, 0, scale)) render_page(page, cr, 0, 0, scale);
+  cairo_destroy(cr);
+  cairo_surface_flush(surf);
 
-    cairo_save(cr);
-    cairo_set_source_rgb(cr, 1, 1, 1);
-    cairo_rectangle(cr, startX, yL, drawLW, drawLH);
-    cairo_fill(cr);
-    cairo_rectangle(cr, startX + drawLW + gap, yR, drawRW, drawRH);
-    cairo_fill(cr);
-    cairo_restore(cr);
+  g_object_unref(page);
+  return surf;
+}
 
-    render_page(left, cr, startX, yL, scale);
-    render_page(right, cr, startX + drawLW + gap, yR, scale);
-  }
+static RenderJob make_tile_job(AppState* s, int page_idx, double scale, int tile_x, int tile_y) {
+  RenderJob job = make_render_job(s, page_idx, scale);
+  job.key.tile_x = tile_x;
+  job.key.tile_y = tile_y;
+  return job;
+}
+
+static RenderJob make_preview_job(AppState* s, int page_idx, double scale) {
+  RenderJob job = make_render_job(s, page_idx, scale);
+  job.key.preview = true;
+  return job;
+}
 
-  if (right) g_object_unref(right);
-  g_object_unref(left);
+static const int PYRAMID_MAX_SIDE = 3072; // pixels, largest pyramid level kept per page
+
+// Mipmap pyramid: whole-page renders at power-of-two scales. A zoom step draws
+// the nearest level at or below the target scaled right away while the exact scale
+// is rendered, so the stand-in never costs more pixels than the exact rendering.
+// w, h are the page size in pixels at scale.
+static RenderJob make_pyramid_job(AppState* s, int page_idx, double scale, double w, double h) {
+  double level = std::pow(2.0, std::floor(std::log2(scale)));
+  const double long_side = std::max(w, h) * level / scale;
+  if (long_side > PYRAMID_MAX_SIDE) level *= std::pow(2.0, -std::ceil(std::log2(long_side / PYRAMID_MAX_SIDE)));
+  return make_render_job(s, page_idx, level);
+}
 
-  // ===== Draw zoom overlay (B)
-  if (s->zoom_overlay) {
-    /* visual zoom overlay disabled in test v5h */
-  }
+// First pass of progressive rendering: the page's embedded thumbnail when it
+// has one, otherwise a low-resolution render. Drawn scaled up until the real
+// rendering arrives.
+static cairo_surface_t* rasterize_preview(PopplerDocument* doc, int page_idx, double scale, ScanCache* scan) {
+  PopplerPage* page = poppler_document_get_page(doc, page_idx);
+  if (!page) return nullptr;
+  cairo_surface_t* thumb = poppler_page_get_thumbnail(page);
+  g_object_unref(page);
+  if (thumb) return thumb;
+  return rasterize_page(doc, page_idx, scale, scan);
+}
 
+// Renders one RENDER_TILE_SIZE tile of the page at scale; edge tiles are cropped.
+static cairo_surface_t* rasterize_tile(PopplerDocument* doc, int page_idx, double scale, int tile_x, int tile_y, ScanCache* scan) {
+  PopplerPage* page = poppler_document_get_page(doc, page_idx);
+  if (!page) return nullptr;
 
-  if (s->page_overlay) {
-    /* visual page overlay disabled in test v5h */
+  double pw = 0, ph = 0;
+  poppler_page_get_size(page, &pw, &ph);
+  const int page_w = std::max(1, (int)std::ceil(pw * scale));
+  const int page_h = std::max(1, (int)std::ceil(ph * scale));
+  const int x0 = tile_x * RENDER_TILE_SIZE;
+  const int y0 = tile_y * RENDER_TILE_SIZE;
+  if (x0 >= page_w || y0 >= page_h) {
+    g_object_unref(page);
+    return nullptr;
   }
 
+  const int w = std::min(RENDER_TILE_SIZE, page_w - x0);
+  const int h = std::min(RENDER_TILE_SIZE, page_h - y0);
+  cairo_surface_t* surf = cairo_image_surface_create(CAIRO_FORMAT_RGB24, w, h);
+  if (cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surf);
+    g_object_unref(page);
+    return nullptr;
+  }
 
-  return FALSE;
+  cairo_t* cr = cairo_create(surf);
+  cairo_set_source_rgb(cr, 1, 1, 1);
+  cairo_paint(cr);
+  if (!draw_scan_page(scan, page, page_idx, cr, -x0, -y0, scale)) render_page(page, cr, -x0, -y0, scale);
+  cairo_destroy(cr);
+  cairo_surface_flush(surf);
+
+  g_object_unref(page);
+  return surf;
 }
 
-// Apply fullscreen only after realize
-static void on_realize(GtkWidget* widget, gpointer user_data) {
-  AppState* s = (AppState*)user_data;
-  if (s && s->fullscreen) {
-    gtk_window_fullscreen(GTK_WINDOW(widget));
-    show_cursor(widget);
+// ===== Display modes (key n): night inverts the page, sepia maps luminance onto
+// brown ink on warm paper. Page surfaces are opaque, so only the colour bytes change.
+static const int SEPIA_INK[3]   = { 0x1c, 0x2c, 0x3a }; // b, g, r
+static const int SEPIA_PAPER[3] = { 0x9c, 0xcc, 0xe6 };
+
+static inline uint32_t sepia_pixel(uint32_t p) {
+  const uint32_t b = p & 0xff, g = (p >> 8) & 0xff, r = (p >> 16) & 0xff;
+  const uint32_t lum = (r * 77 + g * 150 + b * 29) >> 8;
+  uint32_t out = p & 0xff000000u;
+  for (int c = 0; c < 3; ++c)
+    out |= (uint32_t)(SEPIA_INK[c] + (((SEPIA_PAPER[c] - SEPIA_INK[c]) * (int)lum) >> 8)) << (8 * c);
+  return out;
+}
+
+static void display_transform_scalar(uint32_t* px, size_t n, DisplayMode mode) {
+  if (mode == DISPLAY_NIGHT) {
+    for (size_t i = 0; i < n; ++i) px[i] ^= 0x00ffffffu;
+  } else {
+    for (size_t i = 0; i < n; ++i) px[i] = sepia_pixel(px[i]);
   }
-  if (s) compute_content_size(s);
 }
 
-static void on_size_allocate(GtkWidget*, GdkRectangle*, gpointer user_data) {
-  AppState* s = (AppState*)user_data;
-  if (!s) return;
-  compute_content_size(s);
-  if (s->pending_recenter) {
-    center_view(s);
-    s->pending_recenter = false;
-    queue_redraw(s);
+#ifdef RDSCORE_X86_SIMD
+// Channels are processed in 32-bit lanes; all products stay below 2^16, so
+// 16-bit multiplies on the low halves are exact.
+static size_t display_transform_sse2(uint32_t* px, size_t n, DisplayMode mode) {
+  const __m128i mask = _mm_set1_epi32(0xff);
+  size_t i = 0;
+  if (mode == DISPLAY_NIGHT) {
+    const __m128i x = _mm_set1_epi32(0x00ffffff);
+    for (; i + 4 <= n; i += 4) {
+      __m128i* p = (__m128i*)(px + i);
+      _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), x));
+    }
+    return i;
+  }
+  const __m128i ink_b = _mm_set1_epi32(SEPIA_INK[0]), ink_g = _mm_set1_epi32(SEPIA_INK[1]), ink_r = _mm_set1_epi32(SEPIA_INK[2]);
+  const __m128i span_b = _mm_set1_epi32(SEPIA_PAPER[0] - SEPIA_INK[0]);
+  const __m128i span_g = _mm_set1_epi32(SEPIA_PAPER[1] - SEPIA_INK[1]);
+  const __m128i span_r = _mm_set1_epi32(SEPIA_PAPER[2] - SEPIA_INK[2]);
+  const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+  for (; i + 4 <= n; i += 4) {
+    __m128i* p = (__m128i*)(px + i);
+    const __m128i v = _mm_loadu_si128(p);
+    const __m128i b = _mm_and_si128(v, mask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(v, 8), mask);
+    const __m128i r = _mm_and_si128(_mm_srli_epi32(v, 16), mask);
+    __m128i lum = _mm_add_epi32(_mm_mullo_epi16(r, _mm_set1_epi32(77)),
+                                _mm_add_epi32(_mm_mullo_epi16(g, _mm_set1_epi32(150)), _mm_mullo_epi16(b, _mm_set1_epi32(29))));
+    lum = _mm_srli_epi32(lum, 8);
+    const __m128i ob = _mm_add_epi32(ink_b, _mm_srli_epi32(_mm_mullo_epi16(span_b, lum), 8));
+    const __m128i og = _mm_add_epi32(ink_g, _mm_srli_epi32(_mm_mullo_epi16(span_g, lum), 8));
+    const __m128i orr = _mm_add_epi32(ink_r, _mm_srli_epi32(_mm_mullo_epi16(span_r, lum), 8));
+    const __m128i out = _mm_or_si128(_mm_and_si128(v, alpha),
+                                     _mm_or_si128(_mm_slli_epi32(orr, 16), _mm_or_si128(_mm_slli_epi32(og, 8), ob)));
+    _mm_storeu_si128(p, out);
   }
+  return i;
 }
 
+__attribute__((target("avx2")))
+static size_t display_transform_avx2(uint32_t* px, size_t n, DisplayMode mode) {
+  const __m256i mask = _mm256_set1_epi32(0xff);
+  size_t i = 0;
+  if (mode == DISPLAY_NIGHT) {
+    const __m256i x = _mm256_set1_epi32(0x00ffffff);
+    for (; i + 8 <= n; i += 8) {
+      __m256i* p = (__m256i*)(px + i);
+      _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), x));
+    }
+    return i;
+  }
+  const __m256i ink_b = _mm256_set1_epi32(SEPIA_INK[0]), ink_g = _mm256_set1_epi32(SEPIA_INK[1]), ink_r = _mm256_set1_epi32(SEPIA_INK[2]);
+  const __m256i span_b = _mm256_set1_epi32(SEPIA_PAPER[0] - SEPIA_INK[0]);
+  const __m256i span_g = _mm256_set1_epi32(SEPIA_PAPER[1] - SEPIA_INK[1]);
+  const __m256i span_r = _mm256_set1_epi32(SEPIA_PAPER[2] - SEPIA_INK[2]);
+  const __m256i alpha = _mm256_set1_epi32((int)0xff000000u);
+  for (; i + 8 <= n; i += 8) {
+    __m256i* p = (__m256i*)(px + i);
+    const __m256i v = _mm256_loadu_si256(p);
+    const __m256i b = _mm256_and_si256(v, mask);
+    const __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+    const __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+    __m256i lum = _mm256_add_epi32(_mm256_mullo_epi16(r, _mm256_set1_epi32(77)),
+                                   _mm256_add_epi32(_mm256_mullo_epi16(g, _mm256_set1_epi32(150)), _mm256_mullo_epi16(b, _mm256_set1_epi32(29))));
+    lum = _mm256_srli_epi32(lum, 8);
+    const __m256i ob = _mm256_add_epi32(ink_b, _mm256_srli_epi32(_mm256_mullo_epi16(span_b, lum), 8));
+    const __m256i og = _mm256_add_epi32(ink_g, _mm256_srli_epi32(_mm256_mullo_epi16(span_g, lum), 8));
+    const __m256i orr = _mm256_add_epi32(ink_r, _mm256_srli_epi32(_mm256_mullo_epi16(span_r, lum), 8));
+    const __m256i out = _mm256_or_si256(_mm256_and_si256(v, alpha),
+                                        _mm256_or_si256(_mm256_slli_epi32(orr, 16), _mm256_or_si256(_mm256_slli_epi32(og, 8), ob)));
+    _mm256_storeu_si256(p, out);
+  }
+  return i;
+}
+#endif
+
+// In place, row by row (rows may be padded).
+static void display_transform(cairo_surface_t* surf, DisplayMode mode) {
+  cairo_surface_flush(surf);
+  unsigned char* data = cairo_image_surface_get_data(surf);
+  const int w = cairo_image_surface_get_width(surf);
+  const int h = cairo_image_surface_get_height(surf);
+  const int stride = cairo_image_surface_get_stride(surf);
+#ifdef RDSCORE_X86_SIMD
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+  for (int y = 0; y < h; ++y) {
+    uint32_t* row = (uint32_t*)(data + (size_t)y * stride);
+    size_t done = 0;
+#ifdef RDSCORE_X86_SIMD
+    done = avx2 ? display_transform_avx2(row, (size_t)w, mode) : display_transform_sse2(row, (size_t)w, mode);
+#endif
+    display_transform_scalar(row + done, (size_t)w - done, mode);
+  }
+  cairo_surface_mark_dirty(surf);
+}
 
+// Colour of an empty page in the current mode (white transformed).
+static void display_paper_rgb(DisplayMode mode, double& r, double& g, double& b) {
+  if (mode == DISPLAY_NIGHT) {
+    r = g = b = 0.0;
+  } else if (mode == DISPLAY_SEPIA) {
+    const uint32_t p = sepia_pixel(0xffffffffu);
+    r = ((p >> 16) & 0xff) / 255.0;
+    g = ((p >> 8) & 0xff) / 255.0;
+    b = (p & 0xff) / 255.0;
+  } else {
+    r = g = b = 1.0;
+  }
+}
 
-static void unload_document(AppState* s) {
-  if (!s) return;
-  if (s->doc) {
-    g_object_unref(s->doc);
-    s->doc = nullptr;
+static void render_cache_entry_free(RenderCacheEntry& entry) {
+  cairo_surface_destroy(entry.surface);
+  if (entry.display) cairo_surface_destroy(entry.display);
+}
+
+// Transformed copy of surf for mode; nullptr if it cannot be allocated.
+// Made without e->mu held, so the render workers are not blocked meanwhile.
+static cairo_surface_t* display_copy(cairo_surface_t* surf, DisplayMode mode) {
+  const int w = cairo_image_surface_get_width(surf);
+  const int h = cairo_image_surface_get_height(surf);
+  cairo_surface_t* copy = cairo_image_surface_create(cairo_image_surface_get_format(surf), w, h);
+  if (cairo_surface_status(copy) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(copy);
+    return nullptr;
   }
-  s->n_pages = 0;
-  s->current_left = 0;
-  s->input_pdf_abs.clear();
-  s->contentW = 1200;
-  s->contentH = 800;
-  if (s->drawing && GTK_IS_WIDGET(s->drawing))
-    gtk_widget_set_size_request(s->drawing, s->contentW, s->contentH);
-  update_status_label(s);
-  queue_redraw(s);
+  cairo_surface_flush(surf);
+  const int src_stride = cairo_image_surface_get_stride(surf);
+  const int dst_stride = cairo_image_surface_get_stride(copy);
+  const unsigned char* src = cairo_image_surface_get_data(surf);
+  unsigned char* dst = cairo_image_surface_get_data(copy);
+  for (int y = 0; y < h; ++y) memcpy(dst + (size_t)y * dst_stride, src + (size_t)y * src_stride, (size_t)w * 4);
+  display_transform(copy, mode);
+  return copy;
 }
 
-static bool reopen_active_setlist(AppState* s);
+// Caller holds e->mu.
+static void render_cache_clear_locked(RenderEngine* e) {
+  for (auto& entry : e->lru) render_cache_entry_free(entry);
+  e->lru.clear();
+  e->index.clear();
+  e->pages.clear();
+  e->bytes = 0;
+}
 
-static void close_current_document(AppState* s) {
-  if (!s) return;
-  const bool from_setlist = s->current_doc_from_setlist && !s->active_setlist_path.empty();
-  unload_document(s);
-  show_cursor(s->window);
-  restore_focus(s);
-  if (from_setlist) {
-    s->current_doc_from_setlist = false;
-    reopen_active_setlist(s);
-  } else {
-    s->current_doc_from_setlist = false;
+// Caller holds e->mu. Drops it (about to be erased from the LRU) from e->pages.
+static void render_cache_unindex_page_locked(RenderEngine* e, std::list<RenderCacheEntry>::iterator it) {
+  if (it->key.tile_x >= 0) return;
+  auto found = e->pages.find({ it->key.doc_id, it->key.page });
+  if (found == e->pages.end()) return;
+  auto& entries = found->second;
+  entries.erase(std::remove(entries.begin(), entries.end(), it), entries.end());
+  if (entries.empty()) e->pages.erase(found);
+}
+
+// Caller holds e->mu. Evicts least recently used surfaces until the cache fits
+// its share of the memory budget, but never what is on screen nor the most recent one.
+static void render_cache_trim_locked(RenderEngine* e) {
+  const size_t limit = e->budget ? memory_budget_cache_limit(e->budget) : (size_t)256 << 20;
+  auto it = e->lru.end();
+  while (e->bytes > limit && it != e->lru.begin()) {
+    --it;
+    if (it == e->lru.begin()) break;
+    if (e->pinned.count(it->key)) continue;
+    e->bytes -= it->bytes;
+    render_cache_entry_free(*it);
+    e->index.erase(it->key);
+    render_cache_unindex_page_locked(e, it);
+    it = e->lru.erase(it);
   }
 }
 
-static bool load_document_from_path(AppState* s, const std::string& path, bool show_errors = true, bool from_setlist = false) {
-  if (!s) return false;
-  char* abs_path = g_canonicalize_filename(path.c_str(), nullptr);
-  if (!abs_path) {
-    if (show_errors) info_box(s, "Invalid path.");
-    return false;
+// Caller holds e->mu. Takes ownership of surf.
+static void render_cache_insert_locked(RenderEngine* e, const RenderKey& key, cairo_surface_t* surf) {
+  auto found = e->index.find(key);
+  if (found != e->index.end()) {
+    e->bytes -= found->second->bytes;
+    render_cache_entry_free(*found->second);
+    render_cache_unindex_page_locked(e, found->second);
+    e->lru.erase(found->second);
+    e->index.erase(found);
   }
 
-  char* uri = g_filename_to_uri(abs_path, nullptr, nullptr);
-  if (!uri) {
-    if (show_errors) info_box(s, "Bad path.");
-    g_free(abs_path);
-    return false;
+  RenderCacheEntry entry;
+  entry.key = key;
+  entry.surface = surf;
+  entry.bytes = (size_t)cairo_image_surface_get_stride(surf) * (size_t)cairo_image_surface_get_height(surf);
+  e->lru.push_front(entry);
+  e->index[key] = e->lru.begin();
+  if (key.tile_x < 0) e->pages[{ key.doc_id, key.page }].push_back(e->lru.begin());
+  e->bytes += entry.bytes;
+
+  render_cache_trim_locked(e);
+}
+
+// Caller holds e->mu. Installs copy (a reference is taken) as the display surface of
+// key if the entry still holds surf and mode is still current.
+static void render_cache_set_display_locked(RenderEngine* e, const RenderKey& key, cairo_surface_t* surf,
+                                            cairo_surface_t* copy, DisplayMode mode) {
+  auto found = e->index.find(key);
+  if (e->display != mode || found == e->index.end() || found->second->surface != surf) return;
+  RenderCacheEntry& entry = *found->second;
+  if (entry.display) {
+    const size_t old = (size_t)cairo_image_surface_get_stride(entry.display) * (size_t)cairo_image_surface_get_height(entry.display);
+    cairo_surface_destroy(entry.display);
+    entry.bytes -= old;
+    e->bytes -= old;
   }
+  const size_t copy_bytes = (size_t)cairo_image_surface_get_stride(copy) * (size_t)cairo_image_surface_get_height(copy);
+  entry.display = cairo_surface_reference(copy);
+  entry.display_mode = mode;
+  entry.bytes += copy_bytes;
+  e->bytes += copy_bytes;
+  render_cache_trim_locked(e);
+}
 
-  GError* err = nullptr;
-  PopplerDocument* new_doc = poppler_document_new_from_file(uri, nullptr, &err);
-  g_free(uri);
+// Caller holds e->mu. Queues the night/sepia copy of key for the workers, visible
+// ones ahead of the renders.
+static void render_engine_queue_transform_locked(RenderEngine* e, const RenderKey& key, bool visible) {
+  if (!e->transforming.insert(key).second) return;
+  RenderJob job;
+  job.key = key;
+  job.visible = visible;
+  job.transform = true;
+  if (visible) e->queue.push_front(job);
+  else e->queue.push_back(job);
+  e->cv.notify_one();
+}
 
-  if (!new_doc) {
-    if (show_errors) {
-      std::string msg = "Impossible d'ouvrir le PDF: ";
-      msg += (err ? err->message : "unknown error");
-      info_box(s, msg);
+// Returns a new reference to the cached surface for key, or to the closest
+// cached whole-page rendering of the same page when allow_stale is set (drawn
+// scaled while the exact one is being rendered). Sets *exact accordingly.
+// In night or sepia mode the transformed copy is returned. While the workers have
+// not made it yet, the previous one (or the plain surface) stands in, not exact.
+static cairo_surface_t* render_cache_lookup(RenderEngine* e, const RenderKey& key, bool allow_stale, bool* exact) {
+  std::lock_guard<std::mutex> lock(e->mu);
+  if (exact) *exact = false;
+
+  RenderCacheEntry* best = nullptr;
+  auto found = e->index.find(key);
+  if (found != e->index.end()) {
+    e->lru.splice(e->lru.begin(), e->lru, found->second);
+    if (exact) *exact = true;
+    best = &*found->second;
+  } else if (allow_stale) {
+    // Closest scale in log terms, preferring a sharper level scaled down over a
+    // blurrier one scaled up, and anything over a preview.
+    double best_score = 0.0;
+    auto page = e->pages.find({ key.doc_id, key.page });
+    for (size_t i = 0; page != e->pages.end() && i < page->second.size(); ++i) {
+      RenderCacheEntry& entry = *page->second[i];
+      double score = std::fabs(std::log((double)std::max(1, entry.key.scale_key) / std::max(1, key.scale_key)));
+      if (entry.key.scale_key < key.scale_key) score += 0.05;
+      if (entry.key.preview) score += 100.0;
+      if (!best || score < best_score) {
+        best = &entry;
+        best_score = score;
+      }
     }
-    if (err) g_error_free(err);
-    g_free(abs_path);
-    return false;
   }
+  if (!best) return nullptr;
+  const DisplayMode mode = e->display;
+  if (mode == DISPLAY_NORMAL) return cairo_surface_reference(best->surface);
+  if (best->display && best->display_mode == mode) return cairo_surface_reference(best->display);
+
+  // Rendered while the mode changed: queued here, since the mode change missed it.
+  render_engine_queue_transform_locked(e, best->key, true);
+  if (exact) *exact = false;
+  return cairo_surface_reference(best->display ? best->display : best->surface);
+}
 
-  const int n_pages = poppler_document_get_n_pages(new_doc);
-  if (n_pages <= 0) {
-    if (show_errors) info_box(s, "PDF sans pages.");
+// Caller holds e->mu. True if any whole-page rendering of the page is cached.
+static bool render_cache_has_page_locked(RenderEngine* e, const RenderKey& key) {
+  return e->pages.count({ key.doc_id, key.page }) > 0;
+}
+
+// Declares what is on screen: visible jobs are queued ahead of everything else,
+// and visible jobs queued for an earlier frame (e.g. a previous zoom step) are dropped.
+// Pages with nothing cached at all get their preview job queued first.
+static void render_engine_want_visible(AppState* s, const std::vector<RenderJob>& jobs,
+                                       const std::vector<RenderJob>& previews) {
+  RenderEngine* e = &s->render;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(e->mu);
+
+    std::set<RenderKey> wanted;
+    for (const auto& job : jobs) wanted.insert(job.key);
+    for (const auto& job : previews) wanted.insert(job.key);
+    e->pinned = wanted;
+
+    for (auto it = e->queue.begin(); it != e->queue.end();) {
+      if (it->visible && !it->transform && !wanted.count(it->key)) {
+        e->pending.erase(it->key);
+        it = e->queue.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (auto it = jobs.rbegin(); it != jobs.rend(); ++it) {
+      if (e->index.count(it->key) || e->pending.count(it->key)) continue;
+      RenderJob job = *it;
+      job.visible = true;
+      e->queue.push_front(job);
+      e->pending.insert(job.key);
+      queued = true;
+    }
+
+    for (auto it = previews.rbegin(); it != previews.rend(); ++it) {
+      if (e->pending.count(it->key) || render_cache_has_page_locked(e, it->key)) continue;
+      RenderJob job = *it;
+      job.visible = true;
+      e->queue.push_front(job);
+      e->pending.insert(job.key);
+      queued = true;
+    }
+  }
+  if (queued) e->cv.notify_all();
+}
+
+// Replaces the queued look-ahead work with jobs (nearest first). Prefetch jobs
+// run after anything visible and do not trigger a redraw when they finish.
+static void render_engine_prefetch(AppState* s, const std::vector<RenderJob>& jobs) {
+  RenderEngine* e = &s->render;
+  bool queued = false;
+  {
+    std::lock_guard<std::mutex> lock(e->mu);
+
+    std::set<RenderKey> wanted;
+    for (const auto& job : jobs) wanted.insert(job.key);
+
+    for (auto it = e->queue.begin(); it != e->queue.end();) {
+      if (!it->visible && !it->transform && !wanted.count(it->key)) {
+        e->pending.erase(it->key);
+        it = e->queue.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    for (const auto& job : jobs) {
+      if (e->index.count(job.key) || e->pending.count(job.key)) continue;
+      e->queue.push_back(job);
+      e->pending.insert(job.key);
+      queued = true;
+    }
+  }
+  if (queued) e->cv.notify_all();
+}
+
+// ===== Disk cache
+static const size_t DISK_CACHE_QUEUE_MAX = 16; // pending writes; further ones are dropped
+
+static void disk_cache_writer(DiskCache* d);
+
+// Lists the directory once (oldest first into the LRU) and starts the writer.
+static void disk_cache_init(DiskCache* d) {
+  if (d->limit == 0) return;
+  d->dir = std::string(g_get_user_cache_dir()) + "/rdscore/pages";
+  if (g_mkdir_with_parents(d->dir.c_str(), 0755) != 0) {
+    d->dir.clear();
+    return;
+  }
+
+  namespace fs = std::filesystem;
+  std::error_code ec;
+  std::vector<std::tuple<fs::file_time_type, uintmax_t, std::string>> found;
+  for (const auto& ent : fs::directory_iterator(d->dir, ec)) {
+    const std::string name = ent.path().filename().string();
+    if (name.find(".tmp") != std::string::npos) { // left by an interrupted write
+      fs::remove(ent.path(), ec);
+      continue;
+    }
+    const uintmax_t size = ent.file_size(ec);
+    if (ec) continue;
+    found.emplace_back(ent.last_write_time(ec), size, name);
+  }
+  std::sort(found.begin(), found.end());
+  for (const auto& f : found) {
+    d->lru.push_front(std::get<2>(f));
+    d->files[std::get<2>(f)] = { (size_t)std::get<1>(f), d->lru.begin() };
+    d->bytes += (size_t)std::get<1>(f);
+  }
+  d->writer = std::thread(disk_cache_writer, d);
+}
+
+static void disk_cache_stop(DiskCache* d) {
+  {
+    std::lock_guard<std::mutex> lock(d->mu);
+    d->quit = true;
+  }
+  d->cv.notify_all();
+  if (d->writer.joinable()) d->writer.join();
+  for (auto& w : d->queue) cairo_surface_destroy(w.surf);
+  d->queue.clear();
+  d->queued.clear();
+}
+
+// Identity of a file for the disk cache; changes whenever the file is rewritten.
+static std::string disk_cache_file_id(const std::string& abs_path) {
+  struct stat st;
+  if (stat(abs_path.c_str(), &st) != 0) return std::string();
+  const std::string ident = abs_path + "\n" + std::to_string((long long)st.st_size) + "\n" +
+                            std::to_string((long long)st.st_mtime);
+  gchar* sum = g_compute_checksum_for_string(G_CHECKSUM_SHA1, ident.c_str(), -1);
+  std::string id = sum ? sum : "";
+  g_free(sum);
+  return id;
+}
+
+static std::string disk_cache_name(const std::string& id, const RenderKey& key) {
+  return id + "-" + std::to_string(key.page) + "-" + std::to_string(key.scale_key) + (key.preview ? "-t" : "") + ".png";
+}
+
+static cairo_surface_t* disk_cache_load(DiskCache* d, const std::string& id, const RenderKey& key) {
+  if (d->dir.empty() || id.empty()) return nullptr;
+  const std::string name = disk_cache_name(id, key);
+  {
+    std::lock_guard<std::mutex> lock(d->mu);
+    auto found = d->files.find(name);
+    if (found == d->files.end()) return nullptr;
+    d->lru.splice(d->lru.begin(), d->lru, found->second.second);
+  }
+
+  const std::string path = d->dir + "/" + name;
+  cairo_surface_t* surf = cairo_image_surface_create_from_png(path.c_str());
+  if (cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surf);
+    return nullptr;
+  }
+  std::error_code ec;
+  std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec); // LRU for the next run
+  return surf;
+}
+
+// Caller holds d->mu. Drops the least recently used files from the index until the
+// cache is 10% under its limit; returns their names for unlinking outside the lock.
+static std::vector<std::string> disk_cache_trim_locked(DiskCache* d) {
+  std::vector<std::string> victims;
+  if (d->bytes <= d->limit) return victims;
+  const size_t target = d->limit / 10 * 9;
+  while (d->bytes > target && !d->lru.empty()) {
+    const std::string name = d->lru.back();
+    d->lru.pop_back();
+    auto found = d->files.find(name);
+    d->bytes -= std::min(d->bytes, found->second.first);
+    d->files.erase(found);
+    victims.push_back(name);
+  }
+  return victims;
+}
+
+// Called from render workers and loader threads: only queues a reference to surf.
+static void disk_cache_store(DiskCache* d, const std::string& id, const RenderKey& key, cairo_surface_t* surf) {
+  if (d->dir.empty() || id.empty()) return;
+  const std::string name = disk_cache_name(id, key);
+  {
+    std::lock_guard<std::mutex> lock(d->mu);
+    if (d->quit || d->files.count(name) || d->queued.count(name) || d->queue.size() >= DISK_CACHE_QUEUE_MAX) return;
+    d->queue.push_back({ name, cairo_surface_reference(surf) });
+    d->queued.insert(name);
+  }
+  d->cv.notify_one();
+}
+
+// Writer thread, at the lowest CPU priority. Each PNG is written under a temporary
+// name and renamed, so readers never see a partial file.
+static void disk_cache_writer(DiskCache* d) {
+  setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+  std::unique_lock<std::mutex> lock(d->mu);
+  while (true) {
+    d->cv.wait(lock, [d] { return d->quit || !d->queue.empty(); });
+    if (d->quit) break;
+    DiskCacheWrite w = d->queue.front();
+    d->queue.pop_front();
+    lock.unlock();
+
+    const std::string path = d->dir + "/" + w.name;
+    const std::string tmp = path + ".tmp" + std::to_string((long)getpid());
+    bool ok = cairo_surface_write_to_png(w.surf, tmp.c_str()) == CAIRO_STATUS_SUCCESS && rename(tmp.c_str(), path.c_str()) == 0;
+    if (!ok) unlink(tmp.c_str());
+    cairo_surface_destroy(w.surf);
+    struct stat st;
+    ok = ok && stat(path.c_str(), &st) == 0;
+
+    lock.lock();
+    d->queued.erase(w.name);
+    if (!ok || d->files.count(w.name)) continue;
+    d->lru.push_front(w.name);
+    d->files[w.name] = { (size_t)st.st_size, d->lru.begin() };
+    d->bytes += (size_t)st.st_size;
+    const std::vector<std::string> victims = disk_cache_trim_locked(d);
+    if (victims.empty()) continue;
+    lock.unlock();
+    for (const auto& name : victims) unlink((d->dir + "/" + name).c_str());
+    lock.lock();
+  }
+}
+
+// Called by render_engine_set_document as it switches documents, so that every later
+// render sample is either for doc_id or dropped.
+static void render_stats_reset(AppState* s, unsigned doc_id) {
+  std::lock_guard<std::mutex> lock(s->stats.mu);
+  s->stats.doc_id = doc_id;
+  s->stats.render_ms = Histogram{};
+  s->stats.draw_ms = Histogram{};
+  s->stats.pages.clear();
+  s->stats.cache_hits = 0;
+  s->stats.cache_misses = 0;
+}
+
+static void render_stats_add_render(AppState* s, unsigned doc_id, int page_idx, double ms) {
+  std::lock_guard<std::mutex> lock(s->stats.mu);
+  if (doc_id != s->stats.doc_id) return;
+  histogram_add(s->stats.render_ms, ms);
+  PageRenderStat& p = s->stats.pages[page_idx];
+  p.renders++;
+  p.total_ms += ms;
+  p.max_ms = std::max(p.max_ms, ms);
+}
+
+// Main thread (the only writer of doc_bytes). Pages become resident as Poppler reads
+// them: measured when renders come in, at most once a second.
+static void render_engine_charge_mapping(AppState* s) {
+  RenderEngine* e = &s->render;
+  const gint64 now = g_get_monotonic_time();
+  if (!e->budget || now - e->mapped_checked < 1000 * 1000) return;
+  e->mapped_checked = now;
+  memory_budget_recharge(e->budget, e->mapped_charge, mapped_resident_bytes(e->doc_bytes));
+}
+
+static gboolean render_engine_notify_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s) return G_SOURCE_REMOVE;
+  {
+    std::lock_guard<std::mutex> lock(s->render.mu);
+    s->render.notify_queued = false;
+  }
+  render_engine_charge_mapping(s);
+  queue_redraw(s);
+  return G_SOURCE_REMOVE;
+}
+
+static void render_worker_main(AppState* s) {
+  RenderEngine* e = &s->render;
+  PopplerDocument* doc = nullptr;
+  unsigned doc_id = 0;
+  size_t doc_charge = 0; // this worker's PopplerDocument
+  ScanCache scan;
+  scan.store = &e->scan;
+
+  std::unique_lock<std::mutex> lock(e->mu);
+  while (true) {
+    e->cv.wait(lock, [e] { return e->quit || !e->queue.empty(); });
+    if (e->quit) break;
+
+    RenderJob job = e->queue.front();
+    e->queue.pop_front();
+    if (job.transform) {
+      e->transforming.erase(job.key);
+      auto found = e->index.find(job.key);
+      const DisplayMode mode = e->display;
+      if (found == e->index.end() || mode == DISPLAY_NORMAL ||
+          (found->second->display && found->second->display_mode == mode))
+        continue;
+      cairo_surface_t* surf = cairo_surface_reference(found->second->surface);
+      lock.unlock();
+      cairo_surface_t* copy = display_copy(surf, mode);
+      lock.lock();
+      if (copy) {
+        render_cache_set_display_locked(e, job.key, surf, copy, mode);
+        cairo_surface_destroy(copy);
+        if (job.visible && !e->notify_queued) {
+          e->notify_queued = true;
+          g_idle_add(render_engine_notify_cb, s);
+        }
+      }
+      cairo_surface_destroy(surf);
+      continue;
+    }
+    if (job.key.doc_id != e->doc_id) {
+      e->pending.erase(job.key);
+      continue;
+    }
+    const DisplayMode mode = e->display;
+    GBytes* bytes = (doc_id != job.key.doc_id && e->doc_bytes) ? g_bytes_ref(e->doc_bytes) : nullptr;
+    const std::string disk_id = (job.key.tile_x < 0) ? e->disk_id : std::string(); // tiles stay in memory
+    lock.unlock();
+
+    if (doc_id != job.key.doc_id) {
+      if (doc) g_object_unref(doc);
+      scan_store_use(&e->scan, job.key.doc_id, bytes);
+      doc = bytes ? poppler_document_new_from_bytes(bytes, nullptr, nullptr) : nullptr;
+      doc_id = job.key.doc_id;
+      scan.doc_id = doc_id;
+      if (e->budget) memory_budget_recharge(e->budget, doc_charge, doc ? document_state_estimate(g_bytes_get_size(bytes)) : 0);
+    }
+    if (bytes) g_bytes_unref(bytes);
+    cairo_surface_t* surf = disk_cache_load(e->disk, disk_id, job.key);
+    const bool from_disk = surf != nullptr;
+    if (!surf && doc) {
+      const gint64 t0 = g_get_monotonic_time();
+      if (job.key.preview) surf = rasterize_preview(doc, job.key.page, job.scale, &scan);
+      else if (job.key.tile_x < 0) surf = rasterize_page(doc, job.key.page, job.scale, &scan);
+      else surf = rasterize_tile(doc, job.key.page, job.scale, job.key.tile_x, job.key.tile_y, &scan);
+      render_stats_add_render(s, job.key.doc_id, job.key.page, (g_get_monotonic_time() - t0) / 1000.0);
+    }
+    cairo_surface_t* copy = (surf && mode != DISPLAY_NORMAL) ? display_copy(surf, mode) : nullptr;
+
+    lock.lock();
+    e->pending.erase(job.key);
+    if (!surf) continue;
+    if (job.key.doc_id != e->doc_id) {
+      cairo_surface_destroy(surf);
+      if (copy) cairo_surface_destroy(copy);
+      continue;
+    }
+    render_cache_insert_locked(e, job.key, surf);
+    if (copy) {
+      render_cache_set_display_locked(e, job.key, surf, copy, mode);
+      cairo_surface_destroy(copy);
+    }
+    if (job.visible && !e->notify_queued) {
+      e->notify_queued = true;
+      g_idle_add(render_engine_notify_cb, s);
+    }
+    if (!from_disk && !disk_id.empty()) disk_cache_store(e->disk, disk_id, job.key, surf); // queued for the writer
+  }
+  lock.unlock();
+
+  if (doc) g_object_unref(doc);
+  if (e->budget) e->budget->reserved -= doc_charge;
+}
+
+// Independent pages (both sides of a spread, tiles, look-ahead) render in
+// parallel, one PopplerDocument per worker.
+static void render_engine_start(AppState* s) {
+  int n = s->render_threads;
+  if (n <= 0) n = clampi((int)std::thread::hardware_concurrency() - 1, 1, 4);
+  s->render.budget = &s->budget;
+  s->render.scan.budget = &s->budget;
+  s->render.disk = &s->disk;
+  for (int i = 0; i < n; ++i) s->render.workers.emplace_back(render_worker_main, s);
+}
+
+static void render_engine_stop(AppState* s) {
+  RenderEngine* e = &s->render;
+  {
+    std::lock_guard<std::mutex> lock(e->mu);
+    e->quit = true;
+  }
+  e->cv.notify_all();
+  for (auto& w : e->workers) {
+    if (w.joinable()) w.join();
+  }
+  e->workers.clear();
+  {
+    std::lock_guard<std::mutex> lock(e->scan.mu);
+    scan_store_reset_locked(&e->scan);
+  }
+
+  std::lock_guard<std::mutex> lock(e->mu);
+  e->queue.clear();
+  e->pending.clear();
+  e->transforming.clear();
+  render_cache_clear_locked(e);
+  if (e->doc_bytes) g_bytes_unref(e->doc_bytes);
+  e->doc_bytes = nullptr;
+  if (e->budget) {
+    memory_budget_recharge(e->budget, e->doc_charge, 0);
+    memory_budget_recharge(e->budget, e->mapped_charge, 0);
+  }
+}
+
+// Switches the worker to another document (empty uri = none) and drops everything cached.
+// bytes: the mapped document (a reference is taken), or nullptr when closing.
+static void render_engine_set_document(AppState* s, GBytes* bytes, const std::string& disk_id) {
+  RenderEngine* e = &s->render;
+  std::lock_guard<std::mutex> lock(e->mu);
+  render_stats_reset(s, e->doc_id + 1);
+  ++e->doc_id;
+  e->disk_id = disk_id;
+  if (e->doc_bytes) g_bytes_unref(e->doc_bytes);
+  e->doc_bytes = bytes ? g_bytes_ref(bytes) : nullptr;
+  if (e->budget) {
+    // s->doc, and the pages of the mapping the load has touched.
+    memory_budget_recharge(e->budget, e->doc_charge, bytes ? document_state_estimate(g_bytes_get_size(bytes)) : 0);
+    memory_budget_recharge(e->budget, e->mapped_charge, mapped_resident_bytes(bytes));
+    e->mapped_checked = g_get_monotonic_time();
+  }
+  e->queue.clear();
+  e->pending.clear();
+  e->transforming.clear();
+  e->pinned.clear();
+  render_cache_clear_locked(e);
+}
+
+// Back to normal drops the transformed copies. Otherwise everything cached for the
+// document is queued for the workers, what is on screen first; the previous copies
+// stand in until theirs are made.
+static void render_engine_set_display(RenderEngine* e, DisplayMode mode) {
+  {
+    std::lock_guard<std::mutex> lock(e->mu);
+    e->display = mode;
+    for (auto& entry : e->lru) {
+      if (mode != DISPLAY_NORMAL) {
+        if (entry.key.doc_id == e->doc_id) render_engine_queue_transform_locked(e, entry.key, e->pinned.count(entry.key) > 0);
+        continue;
+      }
+      if (!entry.display) continue;
+      const size_t bytes = (size_t)cairo_image_surface_get_stride(entry.display) * (size_t)cairo_image_surface_get_height(entry.display);
+      cairo_surface_destroy(entry.display);
+      entry.display = nullptr;
+      entry.bytes -= bytes;
+      e->bytes -= bytes;
+    }
+  }
+  e->cv.notify_all();
+}
+
+// Blits the rendered page at (x, y), or the closest stale rendering scaled to
+// w x h while the worker catches up. The white page background is already painted.
+// Returns true if the exact rendering was drawn.
+static bool draw_page_surface(AppState* s, cairo_t* cr, const RenderJob& job, double x, double y, double w, double h) {
+  bool exact = false;
+  cairo_surface_t* surf = render_cache_lookup(&s->render, job.key, true, &exact);
+  if (!surf) return false;
+
+  cairo_save(cr);
+  if (exact) {
+    cairo_set_source_surface(cr, surf, std::round(x), std::round(y));
+  } else {
+    cairo_rectangle(cr, x, y, w, h);
+    cairo_clip(cr);
+    cairo_translate(cr, x, y);
+    cairo_scale(cr, w / cairo_image_surface_get_width(surf), h / cairo_image_surface_get_height(surf));
+    cairo_set_source_surface(cr, surf, 0, 0);
+  }
+  cairo_paint(cr);
+  cairo_restore(cr);
+  cairo_surface_destroy(surf);
+  return exact;
+}
+
+// Tiles of the page that intersect the viewport (near) or the viewport grown
+// by one tile on each side (margin), nearest rows first.
+static void collect_page_tiles(AppState* s, const PageSlot& slot, double scale, const GdkRectangle& view,
+                               std::vector<RenderJob>& near_jobs, std::vector<RenderJob>& margin_jobs) {
+  const int T = RENDER_TILE_SIZE;
+  const double px = std::round(slot.x);
+  const double py = std::round(slot.y);
+  const int cols = std::max(1, (int)std::ceil(std::ceil(slot.w) / T));
+  const int rows = std::max(1, (int)std::ceil(std::ceil(slot.h) / T));
+
+  for (int ty = 0; ty < rows; ++ty) {
+    for (int tx = 0; tx < cols; ++tx) {
+      const double tx0 = px + tx * T, ty0 = py + ty * T;
+      const double tx1 = tx0 + T, ty1 = ty0 + T;
+      const bool near = tx1 > view.x && tx0 < view.x + view.width &&
+                        ty1 > view.y && ty0 < view.y + view.height;
+      const bool in_margin = tx1 > view.x - T && tx0 < view.x + view.width + T &&
+                             ty1 > view.y - T && ty0 < view.y + view.height + T;
+      if (near) near_jobs.push_back(make_tile_job(s, slot.page, scale, tx, ty));
+      else if (in_margin) margin_jobs.push_back(make_tile_job(s, slot.page, scale, tx, ty));
+    }
+  }
+}
+
+// Tiles of slot that intersect the rectangle (x0, y0)-(x1, y1).
+static void page_tile_range(const PageSlot& slot, double x0, double y0, double x1, double y1,
+                            int& tx_first, int& tx_last, int& ty_first, int& ty_last) {
+  const int T = RENDER_TILE_SIZE;
+  const double px = std::round(slot.x);
+  const double py = std::round(slot.y);
+  const int cols = std::max(1, (int)std::ceil(std::ceil(slot.w) / T));
+  const int rows = std::max(1, (int)std::ceil(std::ceil(slot.h) / T));
+  tx_first = clampi((int)std::floor((x0 - px) / T), 0, cols - 1);
+  tx_last  = clampi((int)std::floor((x1 - px) / T), 0, cols - 1);
+  ty_first = clampi((int)std::floor((y0 - py) / T), 0, rows - 1);
+  ty_last  = clampi((int)std::floor((y1 - py) / T), 0, rows - 1);
+}
+
+// Blits the rendered tiles of a page that intersect the exposed area. If any is
+// still missing, the closest whole-page rendering is drawn scaled underneath.
+static bool draw_page_tiles(AppState* s, cairo_t* cr, const PageSlot& slot, double scale) {
+  const int T = RENDER_TILE_SIZE;
+  const double px = std::round(slot.x);
+  const double py = std::round(slot.y);
+
+  double cx0 = 0, cy0 = 0, cx1 = 0, cy1 = 0;
+  cairo_clip_extents(cr, &cx0, &cy0, &cx1, &cy1);
+  int tx_first, tx_last, ty_first, ty_last;
+  page_tile_range(slot, cx0, cy0, cx1, cy1, tx_first, tx_last, ty_first, ty_last);
+
+  struct Tile { int tx, ty; cairo_surface_t* surf; };
+  std::vector<Tile> tiles;
+  bool complete = true, missing = false;
+  for (int ty = ty_first; ty <= ty_last; ++ty) {
+    for (int tx = tx_first; tx <= tx_last; ++tx) {
+      bool exact = false;
+      cairo_surface_t* surf = render_cache_lookup(&s->render, make_tile_job(s, slot.page, scale, tx, ty).key, false, &exact);
+      if (surf) s->stats.cache_hits++;
+      else s->stats.cache_misses++;
+      if (!surf) missing = true;
+      if (!surf || !exact) complete = false;
+      tiles.push_back({ tx, ty, surf });
+    }
+  }
+
+  if (missing) draw_page_surface(s, cr, make_render_job(s, slot.page, scale), slot.x, slot.y, slot.w, slot.h);
+
+  for (const auto& t : tiles) {
+    if (!t.surf) continue;
+    cairo_save(cr);
+    cairo_set_source_surface(cr, t.surf, px + t.tx * T, py + t.ty * T);
+    cairo_paint(cr);
+    cairo_restore(cr);
+    cairo_surface_destroy(t.surf);
+  }
+  return complete;
+}
+
+// Look-ahead: the next prefetch_depth spreads and the previous one, each at the
+// scale it will be shown with, so a page turn finds its pages already rendered.
+static void schedule_prefetch(AppState* s, int left_idx, int VW, int VH) {
+  std::vector<RenderJob> jobs;
+
+  // Zoomed views are tiled: look ahead with whole pages at the fit scale instead,
+  // which also gives the current spread a stand-in while its tiles render.
+  const bool tiled = s->zoom > 1.000001;
+  const double prefetch_zoom = tiled ? 1.0 / s->zoom : 1.0;
+
+  if (s->prefetch_depth > 0) {
+    const int last_left = (s->two_pages && s->n_pages >= 2) ? s->n_pages - 2 : s->n_pages - 1;
+
+    std::vector<int> lefts;
+    if (tiled) lefts.push_back(left_idx);
+    if (left_idx + 1 <= last_left) lefts.push_back(left_idx + 1);
+    if (left_idx - 1 >= 0) lefts.push_back(left_idx - 1);
+    for (int k = 2; k <= s->prefetch_depth && left_idx + k <= last_left; ++k) lefts.push_back(left_idx + k);
+
+    for (int l : lefts) {
+      const int r = (s->two_pages && l + 1 < s->n_pages) ? l + 1 : -1;
+      const double scale = spread_scale(s, l, r, VW, VH) * prefetch_zoom;
+      if (scale <= 0.0) continue;
+      jobs.push_back(make_render_job(s, l, scale));
+      if (r >= 0) jobs.push_back(make_render_job(s, r, scale));
+    }
+  }
+
+  render_engine_prefetch(s, jobs);
+}
+
+static std::string format_ms(double ms) {
+  char buf[32];
+  g_snprintf(buf, sizeof buf, "%.1f", ms);
+  return buf;
+}
+
+static std::string histogram_summary(const Histogram& h) {
+  return "p50 " + format_ms(histogram_percentile(h, 0.50)) +
+         "  p95 " + format_ms(histogram_percentile(h, 0.95)) +
+         "  p99 " + format_ms(histogram_percentile(h, 0.99)) +
+         "  max " + format_ms(h.max_ms) + " ms  (n=" + std::to_string(h.n) + ")";
+}
+
+static std::string json_escape(const std::string& in) {
+  std::string out;
+  for (unsigned char c : in) {
+    if (c == '"' || c == '\\') { out += '\\'; out += (char)c; }
+    else if (c == '\n') out += "\\n";
+    else if (c < 0x20) { char buf[8]; g_snprintf(buf, sizeof buf, "\\u%04x", c); out += buf; }
+    else out += (char)c;
+  }
+  return out;
+}
+
+static std::string histogram_json(const Histogram& h) {
+  std::ostringstream o;
+  o << "{\"n\": " << h.n
+    << ", \"mean\": " << (h.n ? h.sum_ms / h.n : 0.0)
+    << ", \"p50\": " << histogram_percentile(h, 0.50)
+    << ", \"p95\": " << histogram_percentile(h, 0.95)
+    << ", \"p99\": " << histogram_percentile(h, 0.99)
+    << ", \"max\": " << h.max_ms << "}";
+  return o.str();
+}
+
+// Statistics of the current document as JSON; pages sorted slowest first.
+static bool write_render_stats(AppState* s, const std::string& path) {
+  std::ofstream out(path);
+  if (!out) return false;
+
+  std::lock_guard<std::mutex> lock(s->stats.mu);
+  std::vector<std::pair<int, PageRenderStat>> pages(s->stats.pages.begin(), s->stats.pages.end());
+  std::sort(pages.begin(), pages.end(), [](const std::pair<int, PageRenderStat>& a, const std::pair<int, PageRenderStat>& b) {
+    return a.second.max_ms > b.second.max_ms;
+  });
+
+  out << "{\n";
+  out << "  \"version\": \"" << RDSCORE_VERSION << "\",\n";
+  out << "  \"document\": \"" << json_escape(s->input_pdf_abs) << "\",\n";
+  out << "  \"pages\": " << s->n_pages << ",\n";
+  out << "  \"render_ms\": " << histogram_json(s->stats.render_ms) << ",\n";
+  out << "  \"draw_ms\": " << histogram_json(s->stats.draw_ms) << ",\n";
+  out << "  \"cache\": {\"hits\": " << s->stats.cache_hits.load() << ", \"misses\": " << s->stats.cache_misses.load() << "},\n";
+  out << "  \"page_render_ms\": [";
+  for (size_t i = 0; i < pages.size(); ++i) {
+    const PageRenderStat& p = pages[i].second;
+    out << (i ? ",\n    " : "\n    ")
+        << "{\"page\": " << pages[i].first + 1 << ", \"renders\": " << p.renders
+        << ", \"total\": " << p.total_ms << ", \"max\": " << p.max_ms << "}";
+  }
+  out << (pages.empty() ? "]\n" : "\n  ]\n");
+  out << "}\n";
+  return (bool)out;
+}
+
+static void dump_render_stats(AppState* s) {
+  std::string path = s->stats_file;
+  if (path.empty()) {
+    const std::string dir = std::string(g_get_user_cache_dir()) + "/rdscore";
+    g_mkdir_with_parents(dir.c_str(), 0755);
+    path = dir + "/render-stats.json";
+  }
+  if (write_render_stats(s, path)) info_box(s, "Statistiques de rendu enregistrées:\n" + path);
+  else info_box(s, "Impossible d'écrire:\n" + path);
+}
+
+// Bottom-right badge for background work (document open, extraction); empty if none.
+static std::string badge_text(AppState* s) {
+  if (s->loading) return "Loading " + basename_only(s->loading->path) + "...  (Esc: cancel)";
+  if (s->extracting) {
+    if (s->extracting->cancelled.load()) return "Cancelling extraction...";
+    return "Extracting pages... " + std::to_string(s->extracting->percent.load()) + "%  (Esc: cancel)";
+  }
+  return std::string();
+}
+
+// Advance of the badge text, measured again only when the text changes.
+static int badge_text_width(AppState* s, const std::string& text) {
+  if (s->badge_measure_cr && text == s->badge_measured) return s->badge_text_w;
+  if (!s->badge_measure_cr) {
+    cairo_surface_t* scratch = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1);
+    s->badge_measure_cr = cairo_create(scratch);
+    cairo_surface_destroy(scratch);
+    cairo_select_font_face(s->badge_measure_cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+    cairo_set_font_size(s->badge_measure_cr, 14.0);
+  }
+  cairo_text_extents_t ext;
+  cairo_text_extents(s->badge_measure_cr, text.c_str(), &ext);
+  s->badge_measured = text;
+  s->badge_text_w = (int)std::ceil(ext.x_advance);
+  return s->badge_text_w;
+}
+
+// Where draw_badge paints text.
+static GdkRectangle badge_geometry(AppState* s, const GdkRectangle& view, const std::string& text) {
+  const int w = badge_text_width(s, text) + 20, h = 30;
+  return { view.x + view.width - w - 12, view.y + view.height - h - 12, w, h };
+}
+
+static void draw_badge(AppState* s, cairo_t* cr, const GdkRectangle& view, const std::string& text) {
+  const GdkRectangle r = badge_geometry(s, view, text);
+  cairo_save(cr);
+  cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, 14.0);
+  cairo_set_source_rgba(cr, 0, 0, 0, 0.72);
+  cairo_rectangle(cr, r.x, r.y, r.width, r.height);
+  cairo_fill(cr);
+  cairo_set_source_rgb(cr, 1, 1, 1);
+  cairo_move_to(cr, r.x + 10.0, r.y + 20.0);
+  cairo_show_text(cr, text.c_str());
+  cairo_restore(cr);
+  s->badge_rect = r;
+}
+
+static std::vector<std::string> hud_lines(AppState* s) {
+  std::vector<std::string> lines;
+  {
+    std::lock_guard<std::mutex> lock(s->stats.mu);
+    lines.push_back("render " + histogram_summary(s->stats.render_ms));
+    lines.push_back("draw   " + histogram_summary(s->stats.draw_ms));
+  }
+  const uint64_t hits = s->stats.cache_hits.load();
+  const uint64_t misses = s->stats.cache_misses.load();
+  const uint64_t lookups = hits + misses;
+  lines.push_back("cache  " + std::to_string(hits) + " hits / " + std::to_string(misses) + " misses (" +
+                  std::to_string(lookups ? (int)(100 * hits / lookups) : 0) + "% hit)");
+  {
+    std::lock_guard<std::mutex> lock(s->render.mu);
+    lines.push_back("memory " + std::to_string(s->render.bytes >> 20) + " / " +
+                    std::to_string(s->budget.limit >> 20) + " MiB, " +
+                    std::to_string(s->render.lru.size()) + " surfaces, " +
+                    std::to_string(s->render.queue.size()) + " queued");
+  }
+  return lines;
+}
+
+static const int HUD_LINE_H = 16;
+static const int HUD_LINES = 4; // what hud_lines returns
+
+static GdkRectangle hud_geometry(const GdkRectangle& view) {
+  return { view.x + 10, view.y + 10, 560, HUD_LINE_H * HUD_LINES + 12 };
+}
+
+// Render statistics box in the top-left corner of the viewport.
+static void draw_hud(AppState* s, cairo_t* cr, const GdkRectangle& view) {
+  const std::vector<std::string> lines = hud_lines(s);
+  const GdkRectangle r = hud_geometry(view);
+
+  cairo_save(cr);
+  cairo_set_source_rgba(cr, 0, 0, 0, 0.72);
+  cairo_rectangle(cr, r.x, r.y, r.width, r.height);
+  cairo_fill(cr);
+  cairo_select_font_face(cr, "monospace", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, 12.0);
+  cairo_set_source_rgb(cr, 0.85, 1.0, 0.85);
+  for (size_t i = 0; i < lines.size(); ++i) {
+    cairo_move_to(cr, r.x + 8.0, r.y + 6.0 + HUD_LINE_H * (i + 1) - 4.0);
+    cairo_show_text(cr, lines[i].c_str());
+  }
+  cairo_restore(cr);
+  s->hud_rect = r;
+}
+
+static void queue_draw_union(GtkWidget* w, const GdkRectangle& a, const GdkRectangle& b) {
+  GdkRectangle u = a;
+  if (u.width <= 0 || u.height <= 0) u = b;
+  else if (b.width > 0 && b.height > 0) gdk_rectangle_union(&a, &b, &u);
+  if (u.width > 0 && u.height > 0) gtk_widget_queue_draw_area(w, u.x - 1, u.y - 1, u.width + 2, u.height + 2);
+}
+
+// Invalidates what the HUD and the badge painted last time plus where they go now,
+// so they can grow, shrink or disappear without a full overlay redraw.
+static void queue_overlay_redraw(AppState* s) {
+  if (!s || !s->overlay_area || !GTK_IS_WIDGET(s->overlay_area)) return;
+  GdkRectangle view;
+  get_viewport_rect(s, view);
+  view.x = 0;
+  view.y = 0;
+
+  GdkRectangle hud = { 0, 0, 0, 0 }, badge = { 0, 0, 0, 0 };
+  if (s->show_hud && s->doc) hud = hud_geometry(view);
+  const std::string text = badge_text(s);
+  if (!text.empty()) badge = badge_geometry(s, view, text);
+  queue_draw_union(s->overlay_area, s->hud_rect, hud);
+  queue_draw_union(s->overlay_area, s->badge_rect, badge);
+}
+
+// ===== Search (/ or Ctrl+F): pages are scanned on a worker thread and their hits
+// highlighted as they come in. Enter / Shift+Enter jump to the next / previous page with hits.
+static gboolean search_progress_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  s->search_notify_queued = false;
+  update_status_label(s);
+  queue_redraw(s);
+  return G_SOURCE_REMOVE;
+}
+
+static gboolean search_done_cb(gpointer user_data) {
+  SearchJob* job = (SearchJob*)user_data;
+  job->done = true;
+  update_status_label(job->s);
+  queue_redraw(job->s);
+  return G_SOURCE_REMOVE;
+}
+
+static void search_thread(SearchJob* job) {
+  AppState* s = job->s;
+  if (s->search_doc_bytes != job->bytes) {
+    if (s->search_doc) g_object_unref(s->search_doc);
+    if (s->search_doc_bytes) g_bytes_unref(s->search_doc_bytes);
+    s->search_doc = poppler_document_new_from_bytes(job->bytes, nullptr, nullptr);
+    s->search_doc_bytes = g_bytes_ref(job->bytes);
+    memory_budget_recharge(&s->budget, s->search_doc_charge,
+                           s->search_doc ? document_state_estimate(g_bytes_get_size(job->bytes)) : 0);
+  }
+  PopplerDocument* doc = s->search_doc;
+  gchar* needle = g_utf8_casefold(job->query.c_str(), -1);
+
+  for (int i = 0; doc && i < job->n_pages && !job->cancelled.load(); ++i) {
+    const int p = (job->first_page + i) % job->n_pages;
+    PopplerPage* page = poppler_document_get_page(doc, p);
+    std::vector<PopplerRectangle> rects;
+    bool match = false;
+    if (page) {
+      gchar* text = poppler_page_get_text(page);
+      gchar* folded = text ? g_utf8_casefold(text, -1) : nullptr;
+      match = folded && strstr(folded, needle);
+      g_free(folded);
+      g_free(text);
+    }
+    if (match) {
+      // find_text is case-insensitive; its rectangles have a bottom-left origin.
+      double pw = 0, ph = 0;
+      poppler_page_get_size(page, &pw, &ph);
+      GList* found = poppler_page_find_text(page, job->query.c_str());
+      for (GList* l = found; l; l = l->next) {
+        PopplerRectangle* r = (PopplerRectangle*)l->data;
+        PopplerRectangle t;
+        t.x1 = r->x1;
+        t.x2 = r->x2;
+        t.y1 = ph - r->y2;
+        t.y2 = ph - r->y1;
+        rects.push_back(t);
+        poppler_rectangle_free(r);
+      }
+      g_list_free(found);
+    }
+    if (page) g_object_unref(page);
+
+    {
+      std::lock_guard<std::mutex> lock(job->mu);
+      if (match) job->hits[p] = std::move(rects);
+      job->scanned = i + 1;
+    }
+    if ((match || (i & 31) == 31) && !s->search_notify_queued.exchange(true))
+      g_idle_add(search_progress_cb, s);
+  }
+
+  g_free(needle);
+  if (!job->cancelled.load()) job->done_source = g_idle_add(search_done_cb, job);
+}
+
+// Cancels the running query, if any (waiting for the thread to notice), and forgets its hits.
+static void search_stop(AppState* s) {
+  SearchJob* job = s->search;
+  if (!job) return;
+  s->search = nullptr;
+  job->cancelled = true;
+  if (s->search_thread.joinable()) s->search_thread.join();
+  if (!job->done && job->done_source) g_source_remove(job->done_source); // read after the join
+  g_bytes_unref(job->bytes);
+  delete job;
+  update_status_label(s);
+  queue_redraw(s);
+}
+
+// Drops the search document (document closed, or exit); no search may be running.
+static void search_release_document(AppState* s) {
+  if (s->search_doc) g_object_unref(s->search_doc);
+  if (s->search_doc_bytes) g_bytes_unref(s->search_doc_bytes);
+  s->search_doc = nullptr;
+  s->search_doc_bytes = nullptr;
+  memory_budget_recharge(&s->budget, s->search_doc_charge, 0);
+}
+
+static void search_start(AppState* s, const std::string& query) {
+  search_stop(s);
+  if (query.empty() || !s->doc) return;
+
+  SearchJob* job = new SearchJob;
+  job->s = s;
+  job->query = query;
+  job->n_pages = s->n_pages;
+  job->first_page = s->current_left;
+  {
+    std::lock_guard<std::mutex> lock(s->render.mu);
+    job->bytes = s->render.doc_bytes ? g_bytes_ref(s->render.doc_bytes) : nullptr;
+  }
+  if (!job->bytes) {
+    delete job;
+    return;
+  }
+  s->search = job;
+  update_status_label(s);
+  s->search_thread = std::thread(search_thread, job);
+}
+
+// Next (dir = 1) or previous (dir = -1) page with hits, from the current spread, wrapping around.
+static void search_goto_hit(AppState* s, int dir) {
+  if (!s->search || !s->doc) return;
+  int target = -1;
+  {
+    std::lock_guard<std::mutex> lock(s->search->mu);
+    const auto& hits = s->search->hits;
+    if (hits.empty()) return;
+    const int shown_last = (s->two_pages && s->current_left + 1 < s->n_pages) ? s->current_left + 1 : s->current_left;
+    if (dir > 0) {
+      auto it = hits.upper_bound(shown_last);
+      target = (it != hits.end()) ? it->first : hits.begin()->first;
+    } else {
+      auto it = hits.lower_bound(s->current_left);
+      target = (it != hits.begin()) ? std::prev(it)->first : hits.rbegin()->first;
+    }
+  }
+  if (s->overview) set_overview(s, false);
+  goto_left_page(s, target);
+}
+
+// Highlights the hits on the pages of the spread.
+static void draw_search_hits(AppState* s, cairo_t* cr, const PageSlot* slots, int n_slots) {
+  if (!s->search) return;
+  std::lock_guard<std::mutex> lock(s->search->mu);
+  cairo_save(cr);
+  cairo_set_source_rgba(cr, 1.0, 0.8, 0.0, 0.4);
+  for (int i = 0; i < n_slots; ++i) {
+    auto found = s->search->hits.find(slots[i].page);
+    if (found == s->search->hits.end()) continue;
+    const double k = slots[i].w / std::max(1.0, s->page_sizes[slots[i].page].w);
+    for (const auto& r : found->second)
+      cairo_rectangle(cr, slots[i].x + r.x1 * k, slots[i].y + r.y1 * k, (r.x2 - r.x1) * k, (r.y2 - r.y1) * k);
+  }
+  cairo_fill(cr);
+  cairo_restore(cr);
+}
+
+static void on_search_changed(GtkEditable* editable, gpointer user_data) {
+  search_start((AppState*)user_data, gtk_entry_get_text(GTK_ENTRY(editable)));
+}
+
+static void on_search_activate(GtkEntry*, gpointer user_data) {
+  search_goto_hit((AppState*)user_data, +1);
+}
+
+// Esc closes the search (hits included); Shift+Enter goes back.
+static gboolean on_search_key(GtkWidget*, GdkEventKey* ev, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (ev->keyval == GDK_KEY_Escape) {
+    gtk_widget_hide(s->search_entry);
+    search_stop(s);
+    restore_focus(s);
+    return TRUE;
+  }
+  if ((ev->keyval == GDK_KEY_Return || ev->keyval == GDK_KEY_KP_Enter) && (ev->state & GDK_SHIFT_MASK)) {
+    search_goto_hit(s, -1);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void open_search(AppState* s) {
+  if (!s->doc || !s->search_entry) return;
+  gtk_widget_show(s->search_entry);
+  gtk_widget_grab_focus(s->search_entry);
+  gtk_editable_select_region(GTK_EDITABLE(s->search_entry), 0, -1);
+}
+
+static void retained_spread_clear(AppState* s) {
+  RetainedSpread& r = s->retained;
+  if (r.surf) cairo_surface_destroy(r.surf);
+  s->budget.reserved -= r.bytes;
+  r = RetainedSpread{};
+}
+
+static int retained_mod(int v, int n) { return ((v % n) + n) % n; }
+
+// A part of an area (drawing-area coordinates) that does not cross the wrap-around,
+// and where it is kept in the surface.
+struct RetainedPiece {
+  GdkRectangle area;
+  int sx, sy;
+};
+
+static std::vector<RetainedPiece> retained_spread_pieces(const RetainedSpread& r, const GdkRectangle& g) {
+  std::vector<RetainedPiece> pieces;
+  const int SW = r.rect.width, SH = r.rect.height;
+  for (int ay = g.y; ay < g.y + g.height;) {
+    const int sy = retained_mod(ay, SH);
+    const int by = std::min(g.y + g.height, ay + SH - sy);
+    for (int ax = g.x; ax < g.x + g.width;) {
+      const int sx = retained_mod(ax, SW);
+      const int bx = std::min(g.x + g.width, ax + SW - sx);
+      pieces.push_back({ { ax, ay, bx - ax, by - ay }, sx, sy });
+      ax = bx;
+    }
+    ay = by;
+  }
+  return pieces;
+}
+
+struct RetainedTile { double x, y; cairo_surface_t* surf; };
+
+// References to the cached tiles covering g, appended to tiles; false if any is missing.
+static bool retained_spread_tiles(AppState* s, const Layout& L, const PageSlot* slots, int n_slots,
+                                  const GdkRectangle& g, std::vector<RetainedTile>& tiles) {
+  const int T = RENDER_TILE_SIZE;
+  for (int i = 0; i < n_slots; ++i) {
+    if (slots[i].x >= g.x + g.width || slots[i].x + slots[i].w <= g.x ||
+        slots[i].y >= g.y + g.height || slots[i].y + slots[i].h <= g.y)
+      continue;
+    int tx_first, tx_last, ty_first, ty_last;
+    page_tile_range(slots[i], g.x, g.y, g.x + g.width - 1, g.y + g.height - 1, tx_first, tx_last, ty_first, ty_last);
+    for (int ty = ty_first; ty <= ty_last; ++ty) {
+      for (int tx = tx_first; tx <= tx_last; ++tx) {
+        bool exact = false;
+        cairo_surface_t* surf = render_cache_lookup(&s->render, make_tile_job(s, slots[i].page, L.scale, tx, ty).key, false, &exact);
+        if (surf && !exact) cairo_surface_destroy(surf); // night/sepia copy not made yet
+        if (!surf || !exact) return false;
+        tiles.push_back({ std::round(slots[i].x) + tx * T, std::round(slots[i].y) + ty * T, surf });
+      }
+    }
+  }
+  return true;
+}
+
+static void retained_tiles_release(std::vector<RetainedTile>& tiles) {
+  for (const auto& t : tiles) cairo_surface_destroy(t.surf);
+  tiles.clear();
+}
+
+// Composites the areas (background, paper, tiles) into the surface.
+static void retained_spread_paint(AppState* s, const PageSlot* slots, int n_slots,
+                                  const std::vector<GdkRectangle>& areas, const std::vector<RetainedTile>& tiles) {
+  RetainedSpread& r = s->retained;
+  double pr, pg, pb;
+  display_paper_rgb(s->render.display, pr, pg, pb);
+  cairo_t* cr = cairo_create(r.surf);
+  for (const auto& g : areas) {
+    for (const auto& p : retained_spread_pieces(r, g)) {
+      cairo_save(cr);
+      cairo_rectangle(cr, p.sx, p.sy, p.area.width, p.area.height);
+      cairo_clip(cr);
+      cairo_translate(cr, p.sx - p.area.x, p.sy - p.area.y);
+      cairo_set_source_rgb(cr, 0.08, 0.08, 0.08);
+      cairo_paint(cr);
+      cairo_set_source_rgb(cr, pr, pg, pb);
+      for (int i = 0; i < n_slots; ++i) cairo_rectangle(cr, slots[i].x, slots[i].y, slots[i].w, slots[i].h);
+      cairo_fill(cr);
+      for (const auto& t : tiles) {
+        cairo_set_source_surface(cr, t.surf, t.x, t.y);
+        cairo_paint(cr);
+      }
+      cairo_restore(cr);
+    }
+  }
+  cairo_destroy(cr);
+  cairo_surface_flush(r.surf);
+}
+
+// The view plus a one-tile margin, inside the drawing area.
+static GdkRectangle retained_spread_rect(int W, int H, const GdkRectangle& view) {
+  const int T = RENDER_TILE_SIZE;
+  GdkRectangle rect;
+  rect.width = std::min(W, view.width + 2 * T);
+  rect.height = std::min(H, view.height + 2 * T);
+  rect.x = clampi(view.x - T, 0, W - rect.width);
+  rect.y = clampi(view.y - T, 0, H - rect.height);
+  return rect;
+}
+
+static bool retained_spread_matches(AppState* s, const Layout& L, int W, int H, const GdkRectangle& view) {
+  const RetainedSpread& r = s->retained;
+  const GdkRectangle want = retained_spread_rect(W, H, view);
+  return r.valid && r.doc_id == s->render.doc_id && r.left == L.left && r.two_pages == L.two_pages &&
+         r.scale_key == render_scale_key(L.scale) && r.display == s->render.display && r.W == W && r.H == H &&
+         r.rect.width == want.width && r.rect.height == want.height;
+}
+
+// True when the retained spread covers view, moving it along if needed: only the strips
+// of the new rect outside the old one are composited, once their tiles are all cached.
+static bool retained_spread_scroll(AppState* s, const Layout& L, const PageSlot* slots, int n_slots,
+                                   int W, int H, const GdkRectangle& view) {
+  RetainedSpread& r = s->retained;
+  if (!retained_spread_matches(s, L, W, H, view)) return false;
+  if (view.x >= r.rect.x && view.y >= r.rect.y &&
+      view.x + view.width <= r.rect.x + r.rect.width && view.y + view.height <= r.rect.y + r.rect.height)
+    return true;
+
+  const GdkRectangle next = retained_spread_rect(W, H, view), old = r.rect;
+  std::vector<GdkRectangle> strips;
+  GdkRectangle common;
+  if (!gdk_rectangle_intersect(&next, &old, &common)) {
+    strips.push_back(next);
+  } else {
+    if (next.y < common.y) strips.push_back({ next.x, next.y, next.width, common.y - next.y });
+    if (next.y + next.height > common.y + common.height)
+      strips.push_back({ next.x, common.y + common.height, next.width, next.y + next.height - common.y - common.height });
+    if (next.x < common.x) strips.push_back({ next.x, common.y, common.x - next.x, common.height });
+    if (next.x + next.width > common.x + common.width)
+      strips.push_back({ common.x + common.width, common.y, next.x + next.width - common.x - common.width, common.height });
+  }
+
+  std::vector<RetainedTile> tiles;
+  for (const auto& g : strips) {
+    if (!retained_spread_tiles(s, L, slots, n_slots, g, tiles)) {
+      retained_tiles_release(tiles);
+      return false;
+    }
+  }
+  retained_spread_paint(s, slots, n_slots, strips, tiles);
+  retained_tiles_release(tiles);
+  r.rect = next;
+  return true;
+}
+
+// Composites the spread around view once every tile there is cached; until then
+// on_draw keeps drawing tile by tile. The surface is reused while its size fits.
+static void retained_spread_build(AppState* s, const Layout& L, const PageSlot* slots, int n_slots,
+                                  int W, int H, const GdkRectangle& view) {
+  RetainedSpread& r = s->retained;
+  const GdkRectangle rect = retained_spread_rect(W, H, view);
+  if (rect.width <= 0 || rect.height <= 0) return;
+  std::vector<RetainedTile> tiles;
+  if (!retained_spread_tiles(s, L, slots, n_slots, rect, tiles)) {
+    retained_tiles_release(tiles);
+    return;
+  }
+
+  if (!r.surf || r.rect.width != rect.width || r.rect.height != rect.height) {
+    retained_spread_clear(s);
+    const size_t bytes = (size_t)cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, rect.width) * (size_t)rect.height;
+    cairo_surface_t* surf = memory_budget_try_reserve(&s->budget, bytes)
+                                ? cairo_image_surface_create(CAIRO_FORMAT_RGB24, rect.width, rect.height) : nullptr;
+    if (!surf || cairo_surface_status(surf) != CAIRO_STATUS_SUCCESS) {
+      if (surf) {
+        cairo_surface_destroy(surf);
+        s->budget.reserved -= bytes;
+      }
+      retained_tiles_release(tiles);
+      return;
+    }
+    r.surf = surf;
+    r.bytes = bytes;
+  }
+  r.rect = rect;
+  retained_spread_paint(s, slots, n_slots, std::vector<GdkRectangle>(1, rect), tiles);
+  retained_tiles_release(tiles);
+  r.valid = true;
+  r.doc_id = s->render.doc_id;
+  r.left = L.left;
+  r.two_pages = L.two_pages;
+  r.scale_key = render_scale_key(L.scale);
+  r.display = s->render.display;
+  r.W = W;
+  r.H = H;
+}
+
+// On screen: one blit per piece of view (at most four where it crosses the wrap-around).
+static void retained_spread_blit(AppState* s, cairo_t* cr, const GdkRectangle& view) {
+  const RetainedSpread& r = s->retained;
+  cairo_save(cr);
+  for (const auto& p : retained_spread_pieces(r, view)) {
+    cairo_set_source_surface(cr, r.surf, p.area.x - p.sx, p.area.y - p.sy);
+    cairo_rectangle(cr, p.area.x, p.area.y, p.area.width, p.area.height);
+    cairo_fill(cr);
+  }
+  cairo_restore(cr);
+}
+
+// Normal -> night -> sepia (key n).
+static void cycle_display_mode(AppState* s) {
+  const DisplayMode next = s->render.display == DISPLAY_NORMAL ? DISPLAY_NIGHT
+                         : s->render.display == DISPLAY_NIGHT  ? DISPLAY_SEPIA
+                                                               : DISPLAY_NORMAL;
+  render_engine_set_display(&s->render, next);
+  retained_spread_clear(s);
+  queue_redraw(s);
+}
+
+// Only the rows in view are requested (nearest to the viewport first, replacing
+// whatever was queued for rows scrolled past); the next screen is prefetched.
+static void draw_overview(AppState* s, cairo_t* cr) {
+  const OverviewGrid g = overview_grid(s);
+  GdkRectangle view;
+  get_viewport_rect(s, view);
+
+  const int visible_rows = view.height / g.cell_h + 2;
+  const int row_first = clampi((view.y - THUMB_GAP) / g.cell_h, 0, std::max(0, g.rows - 1));
+  const int row_last = std::min(g.rows - 1, row_first + visible_rows - 1);
+
+  std::vector<RenderJob> jobs, ahead;
+  std::vector<PageSlot> slots;
+  for (int r = row_first; r <= std::min(g.rows - 1, row_last + visible_rows); ++r) {
+    for (int c = 0; c < g.cols; ++c) {
+      const int idx = r * g.cols + c;
+      if (idx >= s->n_pages) break;
+      double scale = 1.0;
+      const PageSlot slot = overview_cell_slot(s, g, idx, scale);
+      if (r <= row_last) {
+        jobs.push_back(make_render_job(s, idx, scale));
+        slots.push_back(slot);
+      } else {
+        ahead.push_back(make_render_job(s, idx, scale));
+      }
+    }
+  }
+  render_engine_want_visible(s, jobs, std::vector<RenderJob>());
+  render_engine_prefetch(s, ahead);
+
+  double pr, pg, pb;
+  display_paper_rgb(s->render.display, pr, pg, pb);
+  cairo_save(cr);
+  cairo_select_font_face(cr, "Sans", CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
+  cairo_set_font_size(cr, 12.0);
+  for (size_t i = 0; i < slots.size(); ++i) {
+    const PageSlot& slot = slots[i];
+    cairo_set_source_rgb(cr, pr, pg, pb);
+    cairo_rectangle(cr, slot.x, slot.y, slot.w, slot.h);
+    cairo_fill(cr);
+    draw_page_surface(s, cr, jobs[i], slot.x, slot.y, slot.w, slot.h);
+
+    if (slot.page == s->overview_sel) {
+      cairo_set_source_rgb(cr, 0.25, 0.55, 1.0);
+      cairo_set_line_width(cr, 3.0);
+      cairo_rectangle(cr, slot.x - 2.5, slot.y - 2.5, slot.w + 5.0, slot.h + 5.0);
+      cairo_stroke(cr);
+    }
+
+    const std::string label = std::to_string(slot.page + 1);
+    cairo_text_extents_t ext;
+    cairo_text_extents(cr, label.c_str(), &ext);
+    cairo_set_source_rgb(cr, 0.85, 0.85, 0.85);
+    cairo_move_to(cr, slot.x + (slot.w - ext.x_advance) / 2.0, slot.y + slot.h + 14.0);
+    cairo_show_text(cr, label.c_str());
+  }
+  cairo_restore(cr);
+}
+
+static gboolean on_draw(GtkWidget* widget, cairo_t* cr, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s) return FALSE;
+
+  GtkAllocation a;
+  gtk_widget_get_allocation(widget, &a);
+  const int W = std::max(1, a.width);
+  const int H = std::max(1, a.height);
+
+  cairo_save(cr);
+  cairo_set_source_rgb(cr, 0.08, 0.08, 0.08);
+  cairo_paint(cr);
+  cairo_restore(cr);
+
+  s->last_draw_complete = false;
+  if (!s->doc || s->n_pages <= 0) return FALSE;
+
+  if (s->overview) {
+    draw_overview(s, cr);
+    return FALSE;
+  }
+
+  const gint64 draw_start = g_get_monotonic_time();
+  const Layout& L = current_layout(s);
+  const double scale = L.scale;
+
+  const double x0 = (W > L.contentW) ? ((W - L.contentW) / 2.0) : 0.0;
+  const double y0 = (H > L.contentH) ? ((H - L.contentH) / 2.0) : 0.0;
+
+  PageSlot slots[2];
+  const int n_slots = L.n_slots;
+  for (int i = 0; i < n_slots; ++i) {
+    slots[i] = L.slots[i];
+    slots[i].x += x0;
+    slots[i].y += y0;
+  }
+
+  double pr, pg, pb;
+  display_paper_rgb(s->render.display, pr, pg, pb);
+  cairo_save(cr);
+  cairo_set_source_rgb(cr, pr, pg, pb);
+  for (int i = 0; i < n_slots; ++i) {
+    cairo_rectangle(cr, slots[i].x, slots[i].y, slots[i].w, slots[i].h);
+    cairo_fill(cr);
+  }
+  cairo_restore(cr);
+
+  // Above 100% only the tiles around the viewport are rendered.
+  const bool tiled = s->zoom > 1.000001;
+  GdkRectangle view;
+  get_viewport_rect(s, view);
+
+  // Progressive rendering: a small preview (at most ~360 px) first for pages
+  // that have nothing cached yet, then the sharp rendering.
+  std::vector<RenderJob> jobs, previews;
+  for (int i = 0; i < n_slots; ++i) {
+    const double preview_scale = scale * std::min(0.25, 360.0 / std::max(1.0, std::max(slots[i].w, slots[i].h)));
+    previews.push_back(make_preview_job(s, slots[i].page, preview_scale));
+  }
+
+  const bool settling = g_get_monotonic_time() < s->zoom_settle_until;
+  if (settling) {
+    // exact renders wait for zoom_settle_timeout_cb
+  } else if (tiled) {
+    std::vector<RenderJob> near_jobs, margin_jobs;
+    for (int i = 0; i < n_slots; ++i) collect_page_tiles(s, slots[i], scale, view, near_jobs, margin_jobs);
+    jobs = near_jobs;
+    jobs.insert(jobs.end(), margin_jobs.begin(), margin_jobs.end());
+  } else {
+    for (int i = 0; i < n_slots; ++i) jobs.push_back(make_render_job(s, slots[i].page, scale));
+  }
+  // At 100% the fit rendering is all that is needed; pyramid levels only pay off
+  // once the user zooms.
+  const bool zoomed = settling || std::fabs(s->zoom - 1.0) > 1e-6;
+  for (int i = 0; zoomed && i < n_slots; ++i) {
+    const RenderJob level = make_pyramid_job(s, slots[i].page, scale, slots[i].w, slots[i].h);
+    if (std::find_if(jobs.begin(), jobs.end(), [&level](const RenderJob& j) { return j.key == level.key; }) == jobs.end())
+      jobs.push_back(level);
+  }
+  render_engine_want_visible(s, jobs, previews);
+
+  // Scrolling inside the retained spread: a blit, plus the strips that came into view.
+  if (tiled && !settling && retained_spread_scroll(s, L, slots, n_slots, W, H, view)) {
+    retained_spread_blit(s, cr, view);
+    draw_search_hits(s, cr, slots, n_slots);
+    s->last_draw_complete = true;
+    schedule_prefetch(s, L.left, L.VW, L.VH);
+    std::lock_guard<std::mutex> lock(s->stats.mu);
+    histogram_add(s->stats.draw_ms, (g_get_monotonic_time() - draw_start) / 1000.0);
+    return FALSE;
+  }
+
+  bool complete = !settling;
+  for (int i = 0; i < n_slots; ++i) {
+    if (tiled) {
+      if (!draw_page_tiles(s, cr, slots[i], scale)) complete = false;
+    } else if (draw_page_surface(s, cr, make_render_job(s, slots[i].page, scale), slots[i].x, slots[i].y, slots[i].w, slots[i].h)) {
+      s->stats.cache_hits++;
+    } else {
+      s->stats.cache_misses++;
+      complete = false;
+    }
+  }
+  draw_search_hits(s, cr, slots, n_slots);
+  s->last_draw_complete = complete;
+  if (tiled && complete) retained_spread_build(s, L, slots, n_slots, W, H, view);
+  else if (!tiled && s->retained.surf) retained_spread_clear(s);
+
+  schedule_prefetch(s, L.left, L.VW, L.VH);
+
+  {
+    std::lock_guard<std::mutex> lock(s->stats.mu);
+    histogram_add(s->stats.draw_ms, (g_get_monotonic_time() - draw_start) / 1000.0);
+  }
+
+  return FALSE;
+}
+
+// Overlay layer: a transparent drawing area stacked on the scrolled window by a
+// GtkOverlay, in viewport coordinates. Redrawing it never re-runs on_draw's layout
+// and render requests.
+static gboolean on_draw_overlay(GtkWidget*, cairo_t* cr, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s) return FALSE;
+
+  GdkRectangle view;
+  get_viewport_rect(s, view);
+  view.x = 0;
+  view.y = 0;
+
+  s->hud_rect = { 0, 0, 0, 0 };
+  s->badge_rect = { 0, 0, 0, 0 };
+  if (s->show_hud && s->doc) draw_hud(s, cr, view);
+  const std::string badge = badge_text(s);
+  if (!badge.empty()) draw_badge(s, cr, view, badge);
+  return FALSE;
+}
+
+// Apply fullscreen only after realize
+static void on_realize(GtkWidget* widget, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (s && s->fullscreen) {
+    gtk_window_fullscreen(GTK_WINDOW(widget));
+    show_cursor(widget);
+  }
+  if (s) compute_content_size(s);
+}
+
+static gboolean on_button_press(GtkWidget*, GdkEventButton* ev, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s || !s->overview || ev->button != 1) return FALSE;
+
+  const OverviewGrid g = overview_grid(s);
+  const int col = (int)std::floor((ev->x - g.x0) / g.cell_w);
+  const int row = (int)std::floor((ev->y - THUMB_GAP) / g.cell_h);
+  if (col < 0 || col >= g.cols || row < 0) return TRUE;
+  const int idx = row * g.cols + col;
+  if (idx < s->n_pages) overview_activate(s, idx);
+  return TRUE;
+}
+
+static void on_size_allocate(GtkWidget*, GdkRectangle*, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (!s) return;
+  compute_content_size(s);
+  if (s->pending_recenter) {
+    center_view(s);
+    s->pending_recenter = false;
+    queue_redraw(s);
+  }
+}
+
+
+
+static void unload_document(AppState* s) {
+  if (!s) return;
+  if (s->doc) {
+    g_object_unref(s->doc);
+    s->doc = nullptr;
+  }
+  render_engine_set_document(s, nullptr, std::string());
+  search_stop(s);
+  search_release_document(s);
+  s->n_pages = 0;
+  s->overview = false;
+  retained_spread_clear(s);
+  s->page_sizes.clear();
+  s->layout.valid = false;
+  s->current_left = 0;
+  s->input_pdf_abs.clear();
+  {
+    std::unique_ptr<QPDF> src;
+    extract_src_take(s, src);
+  }
+  s->contentW = 1200;
+  s->contentH = 800;
+  if (s->drawing && GTK_IS_WIDGET(s->drawing))
+    gtk_widget_set_size_request(s->drawing, s->contentW, s->contentH);
+  update_status_label(s);
+  queue_redraw(s);
+}
+
+static bool reopen_active_setlist(AppState* s);
+static void stop_setlist_play(AppState* s);
+
+static void close_current_document(AppState* s) {
+  if (!s) return;
+  stop_setlist_play(s);
+  const bool from_setlist = s->current_doc_from_setlist && !s->active_setlist_path.empty();
+  unload_document(s);
+  show_cursor(s->window);
+  restore_focus(s);
+  if (from_setlist) {
+    s->current_doc_from_setlist = false;
+    reopen_active_setlist(s);
+  } else {
+    s->current_doc_from_setlist = false;
+  }
+}
+
+// Opens the PDF and reads every page size. Touches no GTK or AppState state, so
+// it can run on a loader thread; cancel is polled between pages.
+static bool open_document_file(const std::string& path, DocumentLoad& out, const std::atomic<bool>& cancel) {
+  char* abs_path = g_canonicalize_filename(path.c_str(), nullptr);
+  if (!abs_path) {
+    out.error = "Invalid path.";
+    return false;
+  }
+  out.abs_path = abs_path;
+  g_free(abs_path);
+
+  // Map the file once; this document and every render worker's copy parse the
+  // same pages, so memory does not grow with the thread count.
+  GError* err = nullptr;
+  GMappedFile* mapped = g_mapped_file_new(out.abs_path.c_str(), FALSE, &err);
+  if (!mapped) {
+    out.error = "Impossible d'ouvrir le PDF: ";
+    out.error += (err ? err->message : "unknown error");
+    if (err) g_error_free(err);
+    return false;
+  }
+  GBytes* bytes = g_mapped_file_get_bytes(mapped);
+  g_mapped_file_unref(mapped);
+
+  PopplerDocument* new_doc = poppler_document_new_from_bytes(bytes, nullptr, &err);
+  if (!new_doc) {
+    out.error = "Impossible d'ouvrir le PDF: ";
+    out.error += (err ? err->message : "unknown error");
+    if (err) g_error_free(err);
+    g_bytes_unref(bytes);
+    return false;
+  }
+
+  const int n_pages = poppler_document_get_n_pages(new_doc);
+  if (n_pages <= 0) {
+    out.error = "PDF sans pages.";
     g_object_unref(new_doc);
-    g_free(abs_path);
+    g_bytes_unref(bytes);
     return false;
   }
 
+  std::vector<PageSize> sizes((size_t)n_pages);
+  for (int i = 0; i < n_pages; ++i) {
+    if (cancel.load()) {
+      g_object_unref(new_doc);
+      g_bytes_unref(bytes);
+      return false;
+    }
+    PopplerPage* page = poppler_document_get_page(new_doc, i);
+    if (!page) {
+      sizes[i] = (i > 0) ? sizes[i - 1] : PageSize{ 612.0, 792.0 };
+      continue;
+    }
+    poppler_page_get_size(page, &sizes[i].w, &sizes[i].h);
+    g_object_unref(page);
+  }
+
+  out.bytes = bytes;
+  out.disk_id = disk_cache_file_id(out.abs_path);
+  out.doc = new_doc;
+  out.n_pages = n_pages;
+  out.sizes = std::move(sizes);
+  return true;
+}
+
+// Swaps the opened document in (main thread); takes ownership of ld.doc.
+static void install_loaded_document(AppState* s, DocumentLoad& ld, bool from_setlist) {
   unload_document(s);
-  s->doc = new_doc;
-  s->n_pages = n_pages;
-  s->input_pdf_abs = abs_path;
-  char* dir = g_path_get_dirname(abs_path);
+  s->doc = ld.doc;
+  ld.doc = nullptr;
+  s->n_pages = ld.n_pages;
+  s->page_sizes = std::move(ld.sizes);
+  render_engine_set_document(s, ld.bytes, ld.disk_id);
+  g_bytes_unref(ld.bytes);
+  ld.bytes = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(s->render.mu);
+    for (const auto& pr : ld.first_spread)
+      render_cache_insert_locked(&s->render, make_render_job(s, pr.page, pr.scale).key, pr.surf);
+  }
+  ld.first_spread.clear();
+  s->input_pdf_abs = ld.abs_path;
+  char* dir = g_path_get_dirname(ld.abs_path.c_str());
   if (dir) {
     s->last_pdf_dir = dir;
     g_free(dir);
   }
-  g_free(abs_path);
   s->current_left = 0;
   s->current_doc_from_setlist = from_setlist;
   normalize_left(s);
@@ -1235,9 +4421,259 @@ static bool load_document_from_path(AppState* s, const std::string& path, bool s
   update_status_label(s);
   trigger_page_overlay(s);
   queue_redraw(s);
+  if (s->search_entry && gtk_widget_get_visible(s->search_entry))
+    search_start(s, gtk_entry_get_text(GTK_ENTRY(s->search_entry)));
+}
+
+static void document_load_release(DocumentLoad& ld) {
+  if (ld.doc) g_object_unref(ld.doc);
+  if (ld.bytes) g_bytes_unref(ld.bytes);
+  for (const auto& pr : ld.first_spread) cairo_surface_destroy(pr.surf);
+  ld.doc = nullptr;
+  ld.bytes = nullptr;
+  ld.first_spread.clear();
+}
+
+static void cancel_document_load(AppState* s) {
+  if (!s || !s->loading) return;
+  s->loading->cancelled = true; // freed by document_load_done_cb
+  s->loading = nullptr;
+  update_status_label(s);
+  queue_overlay_redraw(s);
+}
+
+// Synchronous open (used by --bench); interactive paths use load_document_async.
+static bool load_document_from_path(AppState* s, const std::string& path, bool show_errors = true, bool from_setlist = false) {
+  if (!s) return false;
+  cancel_document_load(s);
+
+  DocumentLoad ld;
+  const std::atomic<bool> never_cancelled(false);
+  if (!open_document_file(path, ld, never_cancelled)) {
+    if (show_errors && !ld.error.empty()) info_box(s, ld.error);
+    return false;
+  }
+  install_loaded_document(s, ld, from_setlist);
+  return true;
+}
+
+static void setlist_play_preload_next(AppState* s);
+
+// A finished preload holds its mapping (the pages read so far), its PopplerDocument
+// and its first spread.
+static void preload_charge(AppState* s, PendingLoad* pl) {
+  const DocumentLoad& ld = pl->result;
+  const size_t size = ld.bytes ? g_bytes_get_size(ld.bytes) : 0;
+  pl->charged = mapped_resident_bytes(ld.bytes) + (ld.doc ? document_state_estimate(size) : 0);
+  for (const auto& pr : ld.first_spread)
+    pl->charged += (size_t)cairo_image_surface_get_stride(pr.surf) * (size_t)cairo_image_surface_get_height(pr.surf);
+  s->budget.reserved += pl->charged;
+}
+
+// Before a preload is installed (the render engine charges it from then on) or dropped.
+static void preload_uncharge(AppState* s, PendingLoad* pl) {
+  s->budget.reserved -= pl->charged;
+  pl->charged = 0;
+}
+
+static gboolean document_load_done_cb(gpointer user_data) {
+  PendingLoad* pl = (PendingLoad*)user_data;
+  AppState* s = pl->s;
+  auto thread = s->load_threads.find(pl);
+  if (thread != s->load_threads.end()) {
+    thread->second.join(); // queuing this callback was its last step
+    s->load_threads.erase(thread);
+  }
+  if (pl->cancelled.load() || (s->loading != pl && s->play_preload != pl)) {
+    document_load_release(pl->result);
+    delete pl;
+    return G_SOURCE_REMOVE;
+  }
+  pl->done = true;
+  if (s->play_preload == pl) { // waits for setlist_play_step
+    preload_charge(s, pl);
+    return G_SOURCE_REMOVE;
+  }
+
+  s->loading = nullptr;
+  if (pl->ok) {
+    install_loaded_document(s, pl->result, pl->from_setlist);
+    if (pl->play_index >= 0) {
+      s->play_index = pl->play_index;
+      if (pl->open_at_end) goto_left_page(s, s->n_pages - 1);
+      update_status_label(s);
+      setlist_play_preload_next(s);
+    }
+    if (pl->open_page > 0) goto_left_page(s, pl->open_page);
+  } else {
+    update_status_label(s);
+    queue_overlay_redraw(s);
+    if (pl->show_errors && !pl->result.error.empty()) info_box(s, pl->result.error);
+    if (pl->on_failure) {
+      void (*back)(AppState*) = pl->on_failure;
+      delete pl;
+      back(s);
+      return G_SOURCE_REMOVE;
+    }
+  }
+  delete pl;
+  return G_SOURCE_REMOVE;
+}
+
+// Loader thread body. Besides opening the document it prepares the first
+// spread (disk cache, or its own PopplerDocument) before anyone else sees it.
+static void document_load_thread(PendingLoad* pl) {
+  pl->ok = open_document_file(pl->path, pl->result, pl->cancelled);
+
+  DocumentLoad& ld = pl->result;
+  DiskCache* disk = &pl->s->disk;
+  if (pl->ok && pl->prerender_VW > 0) {
+    const int right = (pl->prerender_two_pages && ld.n_pages >= 2) ? 1 : -1;
+    const PageSize l = ld.sizes[0];
+    const PageSize r = (right >= 0) ? ld.sizes[1] : PageSize{};
+    const double scale = fit_scale(l.w, l.h, r.w, r.h, right >= 0, pl->prerender_VW, pl->prerender_VH) * pl->prerender_zoom;
+    for (int p = 0; p <= std::max(0, right) && !pl->cancelled.load(); ++p) {
+      RenderKey key;
+      key.page = p;
+      key.scale_key = render_scale_key(scale);
+      cairo_surface_t* surf = disk_cache_load(disk, ld.disk_id, key);
+      if (!surf && pl->prerender_render) {
+        surf = rasterize_page(ld.doc, p, scale);
+        if (surf) disk_cache_store(disk, ld.disk_id, key, surf);
+      }
+      if (surf) ld.first_spread.push_back({ p, scale, surf });
+    }
+  }
+  pl->done_source = g_idle_add(document_load_done_cb, pl);
+}
+
+static void start_load_thread(AppState* s, PendingLoad* pl) {
+  s->load_threads[pl] = std::thread(document_load_thread, pl);
+}
+
+// At exit, after cancel_document_load and drop_setlist_preload: waits for the
+// loader threads and frees their loads, whose callbacks will not run any more.
+static void join_load_threads(AppState* s) {
+  for (auto& entry : s->load_threads) {
+    PendingLoad* pl = entry.first;
+    pl->cancelled = true;
+    entry.second.join();
+    if (pl->done_source) g_source_remove(pl->done_source);
+    document_load_release(pl->result);
+    delete pl;
+  }
+  s->load_threads.clear();
+}
+
+static void set_prerender_viewport(AppState* s, PendingLoad* pl) {
+  if (s->zoom > 1.000001) return; // zoomed pages are tiled
+  get_viewport_size(s, pl->prerender_VW, pl->prerender_VH);
+  pl->prerender_two_pages = s->two_pages;
+  pl->prerender_zoom = s->zoom;
+}
+
+// Opens path on a loader thread so the window keeps responding (Esc cancels).
+// The current document stays on screen until the new one is ready.
+static void load_document_async(AppState* s, const std::string& path, bool show_errors = true, bool from_setlist = false,
+                                int play_index = -1, bool open_at_end = false) {
+  if (!s) return;
+  cancel_document_load(s);
+
+  PendingLoad* pl = new PendingLoad;
+  pl->s = s;
+  pl->path = path;
+  pl->show_errors = show_errors;
+  pl->from_setlist = from_setlist;
+  pl->play_index = play_index;
+  pl->open_at_end = open_at_end;
+  if (!open_at_end) set_prerender_viewport(s, pl);
+  s->loading = pl;
+  update_status_label(s);
+  queue_overlay_redraw(s);
+
+  start_load_thread(s, pl);
+}
+
+// ===== Setlist playback
+static void drop_setlist_preload(AppState* s) {
+  PendingLoad* pl = s->play_preload;
+  if (!pl) return;
+  s->play_preload = nullptr;
+  if (pl->done) {
+    preload_uncharge(s, pl);
+    document_load_release(pl->result);
+    delete pl;
+  } else {
+    pl->cancelled = true; // freed by document_load_done_cb
+  }
+}
+
+// Opens the next piece and renders its first spread while the current one is played.
+static void setlist_play_preload_next(AppState* s) {
+  const int idx = s->play_index + 1;
+  if (s->play_preload && s->play_preload->play_index == idx) return;
+  drop_setlist_preload(s);
+  if (s->play_index < 0 || idx >= (int)s->play_items.size()) return;
+
+  PendingLoad* pl = new PendingLoad;
+  pl->s = s;
+  pl->path = s->play_items[idx];
+  pl->show_errors = false;
+  pl->from_setlist = true;
+  pl->play_index = idx;
+  pl->prerender_render = true;
+  set_prerender_viewport(s, pl);
+  s->play_preload = pl;
+  start_load_thread(s, pl);
+}
+
+static bool setlist_play_step(AppState* s, int dir) {
+  if (s->play_index < 0 || s->loading) return false;
+  const int idx = s->play_index + dir;
+  if (idx < 0 || idx >= (int)s->play_items.size()) return false;
+
+  PendingLoad* pl = s->play_preload;
+  if (dir > 0 && pl && pl->play_index == idx) {
+    s->play_preload = nullptr;
+    preload_uncharge(s, pl);
+    if (!pl->done) { // still loading: show it as soon as it is ready
+      pl->show_errors = true;
+      s->loading = pl;
+      update_status_label(s);
+      queue_overlay_redraw(s);
+      return true;
+    }
+    if (pl->ok) {
+      install_loaded_document(s, pl->result, true);
+      s->play_index = idx;
+      update_status_label(s);
+      delete pl;
+      setlist_play_preload_next(s);
+      return true;
+    }
+    document_load_release(pl->result); // failed: retry in the foreground to report the error
+    delete pl;
+  }
+
+  load_document_async(s, s->play_items[idx], true, true, idx, dir < 0);
   return true;
 }
 
+static void stop_setlist_play(AppState* s) {
+  drop_setlist_preload(s);
+  s->play_items.clear();
+  s->play_index = -1;
+  update_status_label(s);
+}
+
+static void start_setlist_play(AppState* s, const std::string& setlist_path, const std::vector<std::string>& items, int start_idx) {
+  stop_setlist_play(s);
+  s->active_setlist_path = setlist_path;
+  s->play_items = items;
+  load_document_async(s, items[start_idx], true, true, start_idx);
+}
+
+// True once an open has started (it completes in document_load_done_cb).
 static bool choose_open_pdf(AppState* s) {
   GtkWidget* dlg = gtk_file_chooser_dialog_new(
       "Open PDF",
@@ -1274,9 +4710,11 @@ static bool choose_open_pdf(AppState* s) {
         s->last_pdf_dir = dir;
         g_free(dir);
       }
+      stop_setlist_play(s);
       s->active_setlist_path.clear();
       s->current_doc_from_setlist = false;
-      ok = load_document_from_path(s, fn, true, false);
+      load_document_async(s, fn, true, false);
+      ok = true;
       g_free(fn);
     }
   }
@@ -1649,20 +5087,615 @@ static bool edit_setlist_file(AppState* s, const std::string& setlist_path, std:
     }
   }
 
-  gtk_widget_destroy(dlg);
-  g_object_unref(store);
-  return saved;
+  gtk_widget_destroy(dlg);
+  g_object_unref(store);
+  return saved;
+}
+
+static bool confirm_delete_setlist(AppState* s, const std::string& setlist_path) {
+  auto items = parse_setlist_file(setlist_path);
+
+  GtkWidget* dlg = gtk_dialog_new_with_buttons(
+      "Delete setlist",
+      GTK_WINDOW(s->window),
+      (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
+      "_Cancel", GTK_RESPONSE_CANCEL,
+      "_Delete", GTK_RESPONSE_OK,
+      nullptr);
+  g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
+
+  GtkWidget* content = gtk_dialog_get_content_area(GTK_DIALOG(dlg));
+  GtkWidget* box = gtk_box_new(GTK_ORIENTATION_VERTICAL, 8);
+  gtk_container_set_border_width(GTK_CONTAINER(box), 10);
+  gtk_container_add(GTK_CONTAINER(content), box);
+
+  std::string title = "Delete setlist:\n" + basename_only(setlist_path) + "\n\nContents:";
+  GtkWidget* label = gtk_label_new(title.c_str());
+  gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
+  gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+
+  GtkWidget* sw = gtk_scrolled_window_new(nullptr, nullptr);
+  gtk_widget_set_size_request(sw, 760, 260);
+  gtk_box_pack_start(GTK_BOX(box), sw, TRUE, TRUE, 0);
+
+  GtkWidget* tv = gtk_text_view_new();
+  gtk_text_view_set_editable(GTK_TEXT_VIEW(tv), FALSE);
+  gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(tv), FALSE);
+  gtk_container_add(GTK_CONTAINER(sw), tv);
+
+  GtkTextBuffer* buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(tv));
+  std::string preview;
+  if (items.empty()) preview = "(empty setlist)\n";
+  else {
+    for (const auto& p : items) {
+      preview += p;
+      preview += "\n";
+    }
+  }
+  gtk_text_buffer_set_text(buf, preview.c_str(), -1);
+
+  gtk_widget_show_all(dlg);
+  dialog_begin(s, dlg);
+  int resp = gtk_dialog_run(GTK_DIALOG(dlg));
+  dialog_end(s);
+  gtk_widget_destroy(dlg);
+
+  return resp == GTK_RESPONSE_OK;
+}
+
+
+static bool choose_rename_setlist_path(AppState* s, const std::string& old_path, std::string& out_path) {
+  GtkWidget* dlg = gtk_file_chooser_dialog_new(
+      "Rename setlist",
+      GTK_WINDOW(s->window),
+      GTK_FILE_CHOOSER_ACTION_SAVE,
+      "_Cancel", GTK_RESPONSE_CANCEL,
+      "_Rename", GTK_RESPONSE_ACCEPT,
+      nullptr);
+
+  std::string dir = get_setlists_directory();
+  if (!dir.empty()) gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dlg), dir.c_str());
+  gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dlg), TRUE);
+  gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dlg), basename_only(old_path).c_str());
+
+  g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
+
+  GtkFileFilter* f = gtk_file_filter_new();
+  gtk_file_filter_set_name(f, "Setlists (*.txt, *.lst, *.setlist)");
+  gtk_file_filter_add_pattern(f, "*.txt");
+  gtk_file_filter_add_pattern(f, "*.lst");
+  gtk_file_filter_add_pattern(f, "*.setlist");
+  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dlg), f);
+
+  bool ok = false;
+  dialog_begin(s, dlg);
+  int resp = gtk_dialog_run(GTK_DIALOG(dlg));
+  dialog_end(s);
+
+  if (resp == GTK_RESPONSE_ACCEPT) {
+    char* fn = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
+    if (fn) {
+      out_path = fn;
+      g_free(fn);
+
+      std::string lower = out_path;
+      std::transform(lower.begin(), lower.end(), lower.begin(),
+                     [](unsigned char c){ return (char)std::tolower(c); });
+      bool has_ext = (lower.size() >= 4 && lower.substr(lower.size() - 4) == ".lst") ||
+                     (lower.size() >= 4 && lower.substr(lower.size() - 4) == ".txt") ||
+                     (lower.size() >= 8 && lower.substr(lower.size() - 8) == ".setlist");
+      if (!has_ext) out_path += ".lst";
+
+      ok = true;
+    }
+  }
+
+  gtk_widget_destroy(dlg);
+  return ok;
+}
+
+static void rename_setlist_dialog(AppState* s) {
+  std::string old_path;
+  if (!choose_setlist_file(s, "Rename setlist", old_path)) return;
+
+  std::string new_path;
+  if (!choose_rename_setlist_path(s, old_path, new_path)) return;
+
+  if (new_path == old_path) return;
+
+  if (::rename(old_path.c_str(), new_path.c_str()) == 0) {
+    if (s->active_setlist_path == old_path) s->active_setlist_path = new_path;
+    info_box(s, "Setlist renamed:\n" + basename_only(old_path) + "\n→ " + basename_only(new_path));
+  } else {
+    info_box(s, "Rename failed:\n" + old_path + "\n→ " + new_path);
+  }
+}
+
+static void create_setlist_dialog(AppState* s) {
+  std::string path;
+  if (!choose_new_setlist_path(s, path)) return;
+  std::vector<std::string> items;
+  edit_setlist_file(s, path, items, true);
+}
+
+static void edit_setlist_dialog(AppState* s) {
+  std::string path;
+  if (!choose_setlist_file(s, "Edit setlist", path)) return;
+  auto items = parse_setlist_file(path);
+  edit_setlist_file(s, path, items, false);
+}
+
+static void delete_setlist_dialog(AppState* s) {
+  std::string path;
+  if (!choose_setlist_file(s, "Delete setlist", path)) return;
+  if (!confirm_delete_setlist(s, path)) return;
+
+  if (std::remove(path.c_str()) == 0) info_box(s, "Setlist deleted:\n" + path);
+  else info_box(s, "Delete failed:\n" + path);
+}
+
+
+
+static bool is_setlist_file_name(const std::string& n) {
+  if (n.size() >= 4 && n.substr(n.size()-4) == ".lst") return true;
+  if (n.size() >= 4 && n.substr(n.size()-4) == ".txt") return true;
+  if (n.size() >= 8 && n.substr(n.size()-8) == ".setlist") return true;
+  return false;
+}
+
+// ===== Library index (Ctrl+L)
+// File layout: magic, then varints and length-prefixed strings. Terms are sorted and
+// prefix-compressed against the previous term; postings are delta-coded.
+static const char LIBRARY_MAGIC[] = "RDSLIB1\n";
+
+static std::string library_index_path() {
+  return std::string(g_get_user_cache_dir()) + "/rdscore/library.idx";
+}
+
+static void put_varint(std::string& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back((char)v);
+}
+
+static bool get_varint(const std::string& in, size_t& pos, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; pos < in.size() && shift < 64; shift += 7) {
+    const unsigned char b = (unsigned char)in[pos++];
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+static void put_string(std::string& out, const std::string& str) {
+  put_varint(out, str.size());
+  out += str;
+}
+
+static bool get_string(const std::string& in, size_t& pos, std::string& str) {
+  uint64_t n = 0;
+  if (!get_varint(in, pos, n) || n > in.size() - pos) return false;
+  str.assign(in, pos, (size_t)n);
+  pos += (size_t)n;
+  return true;
+}
+
+static bool library_index_load(const std::string& path, LibraryIndex& idx) {
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return false;
+  std::stringstream ss;
+  ss << f.rdbuf();
+  const std::string in = ss.str();
+  const size_t magic_len = sizeof(LIBRARY_MAGIC) - 1;
+  if (in.compare(0, magic_len, LIBRARY_MAGIC) != 0) return false;
+
+  size_t pos = magic_len;
+  uint64_t n_docs = 0, n_terms = 0, v = 0;
+  if (!get_varint(in, pos, n_docs)) return false;
+  for (uint64_t i = 0; i < n_docs; ++i) {
+    LibraryDoc d;
+    uint64_t mtime = 0, size = 0, pages = 0;
+    if (!get_string(in, pos, d.path) || !get_varint(in, pos, mtime) || !get_varint(in, pos, size) ||
+        !get_string(in, pos, d.title) || !get_varint(in, pos, pages))
+      return false;
+    d.mtime = (long long)mtime;
+    d.size = (long long)size;
+    d.n_pages = (int)pages;
+    idx.docs.push_back(d);
+  }
+  if (!get_varint(in, pos, n_terms)) return false;
+  std::string term;
+  for (uint64_t i = 0; i < n_terms; ++i) {
+    uint64_t shared = 0, n = 0;
+    std::string suffix;
+    if (!get_varint(in, pos, shared) || shared > term.size() || !get_string(in, pos, suffix) || !get_varint(in, pos, n))
+      return false;
+    term = term.substr(0, (size_t)shared) + suffix;
+    auto& postings = idx.terms[term];
+    uint64_t doc = 0, page = 0;
+    for (uint64_t k = 0; k < n; ++k) {
+      uint64_t d_delta = 0;
+      if (!get_varint(in, pos, d_delta) || !get_varint(in, pos, v)) return false;
+      doc += d_delta;
+      page = d_delta ? v : page + v;
+      if (doc >= n_docs) return false;
+      postings.push_back({ (uint32_t)doc, (uint32_t)page });
+    }
+  }
+  return true;
+}
+
+static bool library_index_save(const std::string& path, const LibraryIndex& idx) {
+  std::string out(LIBRARY_MAGIC);
+  put_varint(out, idx.docs.size());
+  for (const auto& d : idx.docs) {
+    put_string(out, d.path);
+    put_varint(out, (uint64_t)d.mtime);
+    put_varint(out, (uint64_t)d.size);
+    put_string(out, d.title);
+    put_varint(out, (uint64_t)d.n_pages);
+  }
+  put_varint(out, idx.terms.size());
+  const std::string* prev = nullptr;
+  for (const auto& t : idx.terms) {
+    size_t shared = 0;
+    if (prev) {
+      while (shared < prev->size() && shared < t.first.size() && (*prev)[shared] == t.first[shared]) ++shared;
+    }
+    put_varint(out, shared);
+    put_string(out, t.first.substr(shared));
+    put_varint(out, t.second.size());
+    uint32_t doc = 0, page = 0;
+    for (const auto& pg : t.second) {
+      put_varint(out, pg.first - doc);
+      put_varint(out, pg.first == doc ? pg.second - page : pg.second);
+      doc = pg.first;
+      page = pg.second;
+    }
+    prev = &t.first;
+  }
+
+  const std::string tmp = path + ".tmp";
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (!f) return false;
+    f.write(out.data(), (std::streamsize)out.size());
+    if (!f) return false;
+  }
+  return ::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Lower-case words without accents (NFD, marks dropped), at least 2 characters.
+static void library_tokenize(const char* text, uint32_t page, std::map<std::string, std::set<uint32_t>>& words) {
+  if (!text) return;
+  gchar* norm = g_utf8_normalize(text, -1, G_NORMALIZE_NFD);
+  if (!norm) return;
+  std::string word;
+  int chars = 0;
+  auto flush = [&]() {
+    if (chars >= 2 && chars <= 40) words[word].insert(page);
+    word.clear();
+    chars = 0;
+  };
+  for (const gchar* p = norm; *p; p = g_utf8_next_char(p)) {
+    const gunichar c = g_utf8_get_char(p);
+    if (g_unichar_ismark(c)) continue;
+    if (!g_unichar_isalnum(c)) {
+      flush();
+      continue;
+    }
+    gchar buf[6];
+    word.append(buf, g_unichar_to_utf8(g_unichar_tolower(c), buf));
+    ++chars;
+  }
+  flush();
+  g_free(norm);
+}
+
+static void library_tokenize_outline(PopplerDocument* doc, PopplerIndexIter* iter,
+                                     std::map<std::string, std::set<uint32_t>>& words) {
+  do {
+    PopplerAction* action = poppler_index_iter_get_action(iter);
+    if (action) {
+      int page = 0;
+      if (action->type == POPPLER_ACTION_GOTO_DEST && action->goto_dest.dest) {
+        PopplerDest* dest = action->goto_dest.dest;
+        if (dest->type == POPPLER_DEST_NAMED) {
+          PopplerDest* named = poppler_document_find_dest(doc, dest->named_dest);
+          if (named) {
+            page = named->page_num - 1;
+            poppler_dest_free(named);
+          }
+        } else {
+          page = dest->page_num - 1;
+        }
+      }
+      library_tokenize(action->any.title, (uint32_t)std::max(0, page), words);
+      poppler_action_free(action);
+    }
+    PopplerIndexIter* child = poppler_index_iter_get_child(iter);
+    if (child) {
+      library_tokenize_outline(doc, child, words);
+      poppler_index_iter_free(child);
+    }
+  } while (poppler_index_iter_next(iter));
+}
+
+// Reads metadata, outline and page text of one PDF into words (page per word).
+static bool library_read_document(const std::string& path, LibraryDoc& d, std::map<std::string, std::set<uint32_t>>& words,
+                                  const std::atomic<bool>& cancel) {
+  gchar* uri = g_filename_to_uri(path.c_str(), nullptr, nullptr);
+  if (!uri) return false;
+  PopplerDocument* doc = poppler_document_new_from_file(uri, nullptr, nullptr);
+  g_free(uri);
+  if (!doc) return false;
+
+  d.n_pages = poppler_document_get_n_pages(doc);
+  gchar* title = poppler_document_get_title(doc);
+  d.title = (title && *title) ? title : basename_only(path);
+  gchar* meta[] = { title, poppler_document_get_author(doc), poppler_document_get_subject(doc), poppler_document_get_keywords(doc) };
+  for (gchar* m : meta) {
+    library_tokenize(m, 0, words);
+    g_free(m);
+  }
+  library_tokenize(basename_only(path).c_str(), 0, words);
+
+  PopplerIndexIter* iter = poppler_index_iter_new(doc);
+  if (iter) {
+    library_tokenize_outline(doc, iter, words);
+    poppler_index_iter_free(iter);
+  }
+
+  for (int i = 0; i < d.n_pages && !cancel.load(); ++i) {
+    PopplerPage* page = poppler_document_get_page(doc, i);
+    if (!page) continue;
+    gchar* text = poppler_page_get_text(page);
+    library_tokenize(text, (uint32_t)i, words);
+    g_free(text);
+    g_object_unref(page);
+  }
+  g_object_unref(doc);
+  return !cancel.load();
+}
+
+static gboolean library_index_notify_cb(gpointer user_data);
+
+// Heap held by an index, for the memory budget (map nodes counted as 64 bytes).
+static size_t library_index_bytes(const LibraryIndex& idx) {
+  size_t n = idx.docs.capacity() * sizeof(LibraryDoc);
+  for (const auto& d : idx.docs) n += d.path.capacity() + d.title.capacity();
+  for (const auto& t : idx.terms) n += 64 + t.first.capacity() + t.second.capacity() * sizeof(t.second[0]);
+  return n;
+}
+
+static void library_index_publish(AppState* s, std::shared_ptr<const LibraryIndex> idx) {
+  {
+    std::lock_guard<std::mutex> lock(s->library_mu);
+    memory_budget_recharge(&s->budget, s->library_charge, idx ? library_index_bytes(*idx) : 0);
+    s->library = std::move(idx);
+  }
+  g_idle_add(library_index_notify_cb, s);
+}
+
+// Indexer thread: starts from the published index (or the file), drops documents that
+// left every setlist or changed on disk, indexes new and changed ones, saves and publishes.
+static void library_index_thread(AppState* s) {
+  const std::string file = library_index_path();
+  std::shared_ptr<const LibraryIndex> current;
+  {
+    std::lock_guard<std::mutex> lock(s->library_mu);
+    current = s->library;
+  }
+  LibraryIndex idx;
+  bool published = (bool)current;
+  if (current) {
+    idx = *current;
+  } else if (library_index_load(file, idx)) {
+    library_index_publish(s, std::make_shared<LibraryIndex>(idx));
+    published = true;
+  } else {
+    idx = LibraryIndex();
+  }
+
+  std::set<std::string> paths;
+  const std::string dir = get_setlists_directory();
+  if (GDir* gd = g_dir_open(dir.c_str(), 0, nullptr)) {
+    const char* name = nullptr;
+    while ((name = g_dir_read_name(gd)) != nullptr) {
+      if (!is_setlist_file_name(name)) continue;
+      for (const auto& item : parse_setlist_file(dir + "/" + name)) paths.insert(item);
+    }
+    g_dir_close(gd);
+  }
+
+  // Unchanged documents keep their order, so remapped postings stay sorted.
+  std::vector<int> remap(idx.docs.size(), -1);
+  std::vector<LibraryDoc> docs;
+  std::set<std::string> kept;
+  for (size_t i = 0; i < idx.docs.size(); ++i) {
+    const LibraryDoc& d = idx.docs[i];
+    struct stat st;
+    if (!paths.count(d.path) || kept.count(d.path) || stat(d.path.c_str(), &st) != 0 ||
+        (long long)st.st_mtime != d.mtime || (long long)st.st_size != d.size)
+      continue;
+    remap[i] = (int)docs.size();
+    docs.push_back(d);
+    kept.insert(d.path);
+  }
+  std::vector<std::string> todo;
+  for (const auto& p : paths) {
+    if (!kept.count(p)) todo.push_back(p);
+  }
+  const bool dropped = docs.size() != idx.docs.size();
+  if (!dropped && todo.empty()) {
+    if (!published) library_index_publish(s, std::make_shared<LibraryIndex>(std::move(idx)));
+    s->library_running = false;
+    return;
+  }
+
+  if (dropped) {
+    for (auto it = idx.terms.begin(); it != idx.terms.end();) {
+      std::vector<std::pair<uint32_t, uint32_t>> postings;
+      for (const auto& pg : it->second) {
+        if (remap[pg.first] >= 0) postings.push_back({ (uint32_t)remap[pg.first], pg.second });
+      }
+      if (postings.empty()) {
+        it = idx.terms.erase(it);
+      } else {
+        it->second.swap(postings);
+        ++it;
+      }
+    }
+  }
+  idx.docs.swap(docs);
+
+  s->library_left = (int)todo.size();
+  for (const auto& p : todo) {
+    if (s->library_cancel.load()) break;
+    struct stat st;
+    LibraryDoc d;
+    std::map<std::string, std::set<uint32_t>> words;
+    if (stat(p.c_str(), &st) == 0 && library_read_document(p, d, words, s->library_cancel)) {
+      d.path = p;
+      d.mtime = (long long)st.st_mtime;
+      d.size = (long long)st.st_size;
+      const uint32_t doc = (uint32_t)idx.docs.size();
+      idx.docs.push_back(d);
+      for (const auto& w : words) {
+        auto& postings = idx.terms[w.first];
+        for (uint32_t page : w.second) postings.push_back({ doc, page });
+      }
+    }
+    --s->library_left;
+  }
+
+  // A cancelled refresh is not saved: the next one starts again from the file.
+  if (!s->library_cancel.load()) {
+    g_mkdir_with_parents((std::string(g_get_user_cache_dir()) + "/rdscore").c_str(), 0755);
+    library_index_save(file, idx);
+    library_index_publish(s, std::make_shared<LibraryIndex>(std::move(idx)));
+  }
+  s->library_left = 0;
+  s->library_running = false;
+}
+
+// Starts a background refresh unless one is already running.
+static void library_index_refresh(AppState* s) {
+  if (s->library_running.exchange(true)) return;
+  if (s->library_thread.joinable()) s->library_thread.join();
+  s->library_cancel = false;
+  s->library_thread = std::thread(library_index_thread, s);
+}
+
+static void library_index_stop(AppState* s) {
+  s->library_cancel = true;
+  if (s->library_thread.joinable()) s->library_thread.join();
+}
+
+// Pages containing every word of the query; the last word also matches as a prefix
+// (results while typing).
+static std::vector<std::pair<uint32_t, uint32_t>> library_query(const LibraryIndex& idx, const std::string& query) {
+  std::map<std::string, std::set<uint32_t>> words;
+  library_tokenize(query.c_str(), 0, words);
+  std::vector<std::string> terms;
+  for (const auto& w : words) terms.push_back(w.first);
+  // the word typed last, for prefix matching
+  std::string last;
+  {
+    std::map<std::string, std::set<uint32_t>> tail;
+    const size_t sp = query.find_last_of(" \t");
+    library_tokenize(query.c_str() + (sp == std::string::npos ? 0 : sp + 1), 0, tail);
+    if (!tail.empty()) last = tail.begin()->first;
+  }
+
+  std::vector<std::pair<uint32_t, uint32_t>> result;
+  bool first = true;
+  for (const auto& term : terms) {
+    std::vector<std::pair<uint32_t, uint32_t>> matches;
+    if (term == last) {
+      for (auto it = idx.terms.lower_bound(term); it != idx.terms.end() && it->first.compare(0, term.size(), term) == 0; ++it)
+        matches.insert(matches.end(), it->second.begin(), it->second.end());
+      std::sort(matches.begin(), matches.end());
+      matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+    } else {
+      auto found = idx.terms.find(term);
+      if (found != idx.terms.end()) matches = found->second;
+    }
+    if (first) {
+      result.swap(matches);
+      first = false;
+    } else {
+      std::vector<std::pair<uint32_t, uint32_t>> both;
+      std::set_intersection(result.begin(), result.end(), matches.begin(), matches.end(), std::back_inserter(both));
+      result.swap(both);
+    }
+    if (result.empty()) break;
+  }
+  return result;
+}
+
+struct LibraryDialog {
+  AppState* s = nullptr;
+  GtkWidget* entry = nullptr;
+  GtkWidget* status = nullptr;
+  GtkListStore* store = nullptr; // title, page (1-based), path
+};
+
+static void library_dialog_update(LibraryDialog* ld) {
+  std::shared_ptr<const LibraryIndex> idx;
+  {
+    std::lock_guard<std::mutex> lock(ld->s->library_mu);
+    idx = ld->s->library;
+  }
+  gtk_list_store_clear(ld->store);
+
+  std::string status;
+  if (idx) {
+    const gint64 t0 = g_get_monotonic_time();
+    const auto hits = library_query(*idx, gtk_entry_get_text(GTK_ENTRY(ld->entry)));
+    const double ms = (g_get_monotonic_time() - t0) / 1000.0;
+    const size_t shown = std::min<size_t>(hits.size(), 500);
+    for (size_t i = 0; i < shown; ++i) {
+      const LibraryDoc& d = idx->docs[hits[i].first];
+      GtkTreeIter it;
+      gtk_list_store_append(ld->store, &it);
+      gtk_list_store_set(ld->store, &it, 0, d.title.c_str(), 1, (int)hits[i].second + 1, 2, d.path.c_str(), -1);
+    }
+    char buf[64];
+    g_snprintf(buf, sizeof buf, "%.1f", ms);
+    status = std::to_string(hits.size()) + " result(s) in " + buf + " ms | " + std::to_string(idx->docs.size()) + " scores indexed";
+  } else {
+    status = "No index yet";
+  }
+  if (ld->s->library_running.load())
+    status += " | indexing (" + std::to_string(ld->s->library_left.load()) + " left)";
+  gtk_label_set_text(GTK_LABEL(ld->status), status.c_str());
 }
 
-static bool confirm_delete_setlist(AppState* s, const std::string& setlist_path) {
-  auto items = parse_setlist_file(setlist_path);
+static gboolean library_index_notify_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (s->library_dialog) library_dialog_update(s->library_dialog);
+  if (s->catalog_thread.joinable()) setlist_catalog_refresh(s); // page counts; joinable = catalog started
+  return G_SOURCE_REMOVE;
+}
+
+static void library_dialog_changed(GtkEditable*, gpointer user_data) {
+  library_dialog_update((LibraryDialog*)user_data);
+}
+
+static void library_dialog(AppState* s) {
+  if (!s) return;
+  library_index_refresh(s);
 
   GtkWidget* dlg = gtk_dialog_new_with_buttons(
-      "Delete setlist",
+      "Search library",
       GTK_WINDOW(s->window),
       (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
-      "_Cancel", GTK_RESPONSE_CANCEL,
-      "_Delete", GTK_RESPONSE_OK,
+      "_Back", GTK_RESPONSE_CANCEL,
+      "_Open", GTK_RESPONSE_OK,
       nullptr);
   g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
 
@@ -1671,151 +5704,303 @@ static bool confirm_delete_setlist(AppState* s, const std::string& setlist_path)
   gtk_container_set_border_width(GTK_CONTAINER(box), 10);
   gtk_container_add(GTK_CONTAINER(content), box);
 
-  std::string title = "Delete setlist:\n" + basename_only(setlist_path) + "\n\nContents:";
-  GtkWidget* label = gtk_label_new(title.c_str());
-  gtk_label_set_xalign(GTK_LABEL(label), 0.0f);
-  gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
+  LibraryDialog ld;
+  ld.s = s;
+  ld.entry = gtk_search_entry_new();
+  gtk_entry_set_activates_default(GTK_ENTRY(ld.entry), TRUE);
+  gtk_box_pack_start(GTK_BOX(box), ld.entry, FALSE, FALSE, 0);
+  ld.status = gtk_label_new("");
+  gtk_widget_set_halign(ld.status, GTK_ALIGN_START);
+  gtk_box_pack_start(GTK_BOX(box), ld.status, FALSE, FALSE, 0);
+
+  ld.store = gtk_list_store_new(3, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING);
+  GtkWidget* view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(ld.store));
+  GtkCellRenderer* r = gtk_cell_renderer_text_new();
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Score", r, "text", 0, nullptr));
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Page", r, "text", 1, nullptr));
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("File", r, "text", 2, nullptr));
+  gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), TRUE);
+  gtk_tree_selection_set_mode(gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), GTK_SELECTION_BROWSE);
+  g_signal_connect(view, "row-activated", G_CALLBACK(open_setlist_row_activated), dlg);
+  g_signal_connect(view, "key-press-event", G_CALLBACK(open_setlist_key_press), dlg);
 
   GtkWidget* sw = gtk_scrolled_window_new(nullptr, nullptr);
-  gtk_widget_set_size_request(sw, 760, 260);
+  gtk_widget_set_size_request(sw, 1000, 400);
+  gtk_container_add(GTK_CONTAINER(sw), view);
   gtk_box_pack_start(GTK_BOX(box), sw, TRUE, TRUE, 0);
 
-  GtkWidget* tv = gtk_text_view_new();
-  gtk_text_view_set_editable(GTK_TEXT_VIEW(tv), FALSE);
-  gtk_text_view_set_cursor_visible(GTK_TEXT_VIEW(tv), FALSE);
-  gtk_container_add(GTK_CONTAINER(sw), tv);
-
-  GtkTextBuffer* buf = gtk_text_view_get_buffer(GTK_TEXT_VIEW(tv));
-  std::string preview;
-  if (items.empty()) preview = "(empty setlist)\n";
-  else {
-    for (const auto& p : items) {
-      preview += p;
-      preview += "\n";
-    }
-  }
-  gtk_text_buffer_set_text(buf, preview.c_str(), -1);
+  g_signal_connect(ld.entry, "changed", G_CALLBACK(library_dialog_changed), &ld);
+  s->library_dialog = &ld;
+  library_dialog_update(&ld);
 
+  gtk_dialog_set_default_response(GTK_DIALOG(dlg), GTK_RESPONSE_OK);
   gtk_widget_show_all(dlg);
+  gtk_widget_grab_focus(ld.entry);
+
   dialog_begin(s, dlg);
   int resp = gtk_dialog_run(GTK_DIALOG(dlg));
   dialog_end(s);
+  s->library_dialog = nullptr;
+
+  std::string path;
+  int page = 0;
+  if (resp == GTK_RESPONSE_OK) {
+    GtkTreeModel* model = GTK_TREE_MODEL(ld.store);
+    GtkTreeIter it;
+    if (gtk_tree_selection_get_selected(gtk_tree_view_get_selection(GTK_TREE_VIEW(view)), &model, &it) ||
+        gtk_tree_model_get_iter_first(model, &it)) {
+      gchar* p = nullptr;
+      gtk_tree_model_get(model, &it, 1, &page, 2, &p, -1);
+      if (p) path = p;
+      g_free(p);
+    }
+  }
   gtk_widget_destroy(dlg);
+  g_object_unref(ld.store);
 
-  return resp == GTK_RESPONSE_OK;
+  if (path.empty()) return;
+  if (s->doc && path == s->input_pdf_abs) {
+    goto_left_page(s, page - 1);
+    return;
+  }
+  stop_setlist_play(s);
+  s->active_setlist_path.clear();
+  s->current_doc_from_setlist = false;
+  load_document_async(s, path, true, false);
+  if (s->loading) s->loading->open_page = page - 1;
 }
 
+// ===== Setlist catalog
+// Two saves within one second (create then edit, editors writing in steps) share
+// st_mtime: the nanoseconds and the size tell them apart.
+static bool setlist_info_current(const SetlistInfo& info, const struct stat& st) {
+  return info.mtime_ns == (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec &&
+         info.size == (long long)st.st_size;
+}
 
-static bool choose_rename_setlist_path(AppState* s, const std::string& old_path, std::string& out_path) {
-  GtkWidget* dlg = gtk_file_chooser_dialog_new(
-      "Rename setlist",
-      GTK_WINDOW(s->window),
-      GTK_FILE_CHOOSER_ACTION_SAVE,
-      "_Cancel", GTK_RESPONSE_CANCEL,
-      "_Rename", GTK_RESPONSE_ACCEPT,
-      nullptr);
-
-  std::string dir = get_setlists_directory();
-  if (!dir.empty()) gtk_file_chooser_set_current_folder(GTK_FILE_CHOOSER(dlg), dir.c_str());
-  gtk_file_chooser_set_do_overwrite_confirmation(GTK_FILE_CHOOSER(dlg), TRUE);
-  gtk_file_chooser_set_current_name(GTK_FILE_CHOOSER(dlg), basename_only(old_path).c_str());
-
-  g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
-
-  GtkFileFilter* f = gtk_file_filter_new();
-  gtk_file_filter_set_name(f, "Setlists (*.txt, *.lst, *.setlist)");
-  gtk_file_filter_add_pattern(f, "*.txt");
-  gtk_file_filter_add_pattern(f, "*.lst");
-  gtk_file_filter_add_pattern(f, "*.setlist");
-  gtk_file_chooser_add_filter(GTK_FILE_CHOOSER(dlg), f);
+// Page counts come from the library index only: the catalog never opens PDFs itself,
+// so a cold start does not read the library twice. It is rescanned when the index
+// is published.
+static int catalog_page_count(const std::map<std::string, const LibraryDoc*>& library, const std::string& path,
+                              const struct stat& st) {
+  auto found = library.find(path);
+  if (found == library.end()) return -1;
+  const LibraryDoc* d = found->second;
+  return (d->mtime == (long long)st.st_mtime && d->size == (long long)st.st_size) ? d->n_pages : -1;
+}
 
-  bool ok = false;
-  dialog_begin(s, dlg);
-  int resp = gtk_dialog_run(GTK_DIALOG(dlg));
-  dialog_end(s);
+static gboolean setlist_catalog_notify_cb(gpointer user_data);
 
-  if (resp == GTK_RESPONSE_ACCEPT) {
-    char* fn = gtk_file_chooser_get_filename(GTK_FILE_CHOOSER(dlg));
-    if (fn) {
-      out_path = fn;
-      g_free(fn);
+// Heap held by the catalog, for the memory budget (map nodes counted as 64 bytes).
+static size_t setlist_catalog_bytes(const std::map<std::string, SetlistInfo>& catalog) {
+  size_t n = 0;
+  for (const auto& c : catalog) {
+    n += 64 + sizeof(SetlistInfo) + c.first.capacity() + c.second.items.capacity() * sizeof(std::string);
+    for (const auto& item : c.second.items) n += item.capacity();
+  }
+  return n;
+}
 
-      std::string lower = out_path;
-      std::transform(lower.begin(), lower.end(), lower.begin(),
-                     [](unsigned char c){ return (char)std::tolower(c); });
-      bool has_ext = (lower.size() >= 4 && lower.substr(lower.size() - 4) == ".lst") ||
-                     (lower.size() >= 4 && lower.substr(lower.size() - 4) == ".txt") ||
-                     (lower.size() >= 8 && lower.substr(lower.size() - 8) == ".setlist");
-      if (!has_ext) out_path += ".lst";
+static void setlist_catalog_thread(AppState* s) {
+  const std::string dir = get_setlists_directory();
+  while (true) {
+    std::map<std::string, SetlistInfo> previous;
+    {
+      std::lock_guard<std::mutex> lock(s->catalog_mu);
+      previous = s->catalog;
+    }
+    std::shared_ptr<const LibraryIndex> library;
+    {
+      std::lock_guard<std::mutex> lock(s->library_mu);
+      library = s->library;
+    }
+    std::map<std::string, const LibraryDoc*> library_docs;
+    if (library) {
+      for (const auto& d : library->docs) library_docs[d.path] = &d;
+    }
 
-      ok = true;
+    std::map<std::string, SetlistInfo> next;
+    GDir* gd = g_dir_open(dir.c_str(), 0, nullptr);
+    const char* name = nullptr;
+    while (gd && (name = g_dir_read_name(gd)) != nullptr && !s->catalog_cancel.load()) {
+      if (!is_setlist_file_name(name)) continue;
+      const std::string path = dir + "/" + name;
+      struct stat st;
+      if (stat(path.c_str(), &st) != 0) continue;
+
+      SetlistInfo info;
+      auto old = previous.find(name);
+      if (old != previous.end() && setlist_info_current(old->second, st)) info.items = std::move(old->second.items);
+      else info.items = parse_setlist_file(path);
+      info.mtime = (long long)st.st_mtime;
+      info.mtime_ns = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+      info.size = (long long)st.st_size;
+
+      // The PDFs themselves may have changed: checked on every scan.
+      for (const auto& item : info.items) {
+        struct stat ist;
+        if (stat(item.c_str(), &ist) != 0) {
+          ++info.missing;
+          continue;
+        }
+        const int pages = catalog_page_count(library_docs, item, ist);
+        if (pages >= 0) info.total_pages += pages;
+        else ++info.pages_unknown;
+      }
+      next[name] = std::move(info);
+    }
+    if (gd) g_dir_close(gd);
+
+    {
+      std::lock_guard<std::mutex> lock(s->catalog_mu);
+      if (!s->catalog_cancel.load()) {
+        s->catalog.swap(next);
+        memory_budget_recharge(&s->budget, s->catalog_charge, setlist_catalog_bytes(s->catalog));
+        s->catalog_ready = true;
+        g_idle_add(setlist_catalog_notify_cb, s);
+      }
+      // Checked and cleared under the same lock as setlist_catalog_refresh sets them,
+      // so a change reported after this check starts a new thread.
+      if (!s->catalog_again || s->catalog_cancel.load()) {
+        s->catalog_running = false;
+        break;
+      }
+      s->catalog_again = false;
     }
   }
-
-  gtk_widget_destroy(dlg);
-  return ok;
 }
 
-static void rename_setlist_dialog(AppState* s) {
-  std::string old_path;
-  if (!choose_setlist_file(s, "Rename setlist", old_path)) return;
+// Rescans in the background; a change during a scan triggers one more pass.
+static void setlist_catalog_refresh(AppState* s) {
+  {
+    std::lock_guard<std::mutex> lock(s->catalog_mu);
+    if (s->catalog_running) {
+      s->catalog_again = true;
+      return;
+    }
+    s->catalog_running = true;
+    s->catalog_again = false;
+  }
+  if (s->catalog_thread.joinable()) s->catalog_thread.join(); // the previous one has finished
+  s->catalog_thread = std::thread(setlist_catalog_thread, s);
+}
 
-  std::string new_path;
-  if (!choose_rename_setlist_path(s, old_path, new_path)) return;
+static gboolean catalog_refresh_timeout_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  s->catalog_refresh_timer = 0;
+  setlist_catalog_refresh(s);
+  return G_SOURCE_REMOVE;
+}
 
-  if (new_path == old_path) return;
+// Editors write in several steps: changes are coalesced for 200 ms.
+static void on_setlists_dir_changed(GFileMonitor*, GFile*, GFile*, GFileMonitorEvent, gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (s->catalog_refresh_timer) g_source_remove(s->catalog_refresh_timer);
+  s->catalog_refresh_timer = g_timeout_add(200, catalog_refresh_timeout_cb, s);
+}
 
-  if (::rename(old_path.c_str(), new_path.c_str()) == 0) {
-    if (s->active_setlist_path == old_path) s->active_setlist_path = new_path;
-    info_box(s, "Setlist renamed:\n" + basename_only(old_path) + "\n→ " + basename_only(new_path));
-  } else {
-    info_box(s, "Rename failed:\n" + old_path + "\n→ " + new_path);
-  }
+static void setlist_catalog_start(AppState* s) {
+  GFile* dir = g_file_new_for_path(get_setlists_directory().c_str());
+  s->catalog_monitor = g_file_monitor_directory(dir, G_FILE_MONITOR_WATCH_MOVES, nullptr, nullptr);
+  g_object_unref(dir);
+  if (s->catalog_monitor)
+    g_signal_connect(s->catalog_monitor, "changed", G_CALLBACK(on_setlists_dir_changed), s);
+  setlist_catalog_refresh(s);
 }
 
-static void create_setlist_dialog(AppState* s) {
-  std::string path;
-  if (!choose_new_setlist_path(s, path)) return;
-  std::vector<std::string> items;
-  edit_setlist_file(s, path, items, true);
+static void setlist_catalog_stop(AppState* s) {
+  if (s->catalog_refresh_timer) {
+    g_source_remove(s->catalog_refresh_timer);
+    s->catalog_refresh_timer = 0;
+  }
+  if (s->catalog_monitor) {
+    g_file_monitor_cancel(s->catalog_monitor);
+    g_object_unref(s->catalog_monitor);
+    s->catalog_monitor = nullptr;
+  }
+  s->catalog_cancel = true;
+  if (s->catalog_thread.joinable()) s->catalog_thread.join();
 }
 
-static void edit_setlist_dialog(AppState* s) {
-  std::string path;
-  if (!choose_setlist_file(s, "Edit setlist", path)) return;
-  auto items = parse_setlist_file(path);
-  edit_setlist_file(s, path, items, false);
+// Items of a setlist: from the catalog while it matches the file, else parsed.
+static std::vector<std::string> setlist_items(AppState* s, const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    std::lock_guard<std::mutex> lock(s->catalog_mu);
+    auto found = s->catalog.find(basename_only(path));
+    if (found != s->catalog.end() && setlist_info_current(found->second, st) &&
+        path == get_setlists_directory() + "/" + found->first)
+      return found->second.items;
+  }
+  return parse_setlist_file(path);
 }
 
-static void delete_setlist_dialog(AppState* s) {
-  std::string path;
-  if (!choose_setlist_file(s, "Delete setlist", path)) return;
-  if (!confirm_delete_setlist(s, path)) return;
+static void manage_setlists_refresh_store(AppState* s, GtkListStore* store);
 
-  if (std::remove(path.c_str()) == 0) info_box(s, "Setlist deleted:\n" + path);
-  else info_box(s, "Delete failed:\n" + path);
+static gboolean setlist_catalog_notify_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  if (s->manage_store) manage_setlists_refresh_store(s, s->manage_store);
+  return G_SOURCE_REMOVE;
 }
 
+// Columns: name, entries, pages, modified, missing. Filled from the catalog; the
+// directory is only listed (names alone) before its first scan has finished.
+// The selected setlist stays selected.
+static void manage_setlists_refresh_store(AppState* s, GtkListStore* store) {
+  std::string selected;
+  if (s->manage_view && store == s->manage_store) {
+    GtkTreeModel* model = nullptr;
+    GtkTreeIter it;
+    if (gtk_tree_selection_get_selected(gtk_tree_view_get_selection(GTK_TREE_VIEW(s->manage_view)), &model, &it)) {
+      gchar* val = nullptr;
+      gtk_tree_model_get(model, &it, 0, &val, -1);
+      if (val) selected = val;
+      g_free(val);
+    }
+  }
 
-
-static void manage_setlists_refresh_store(GtkListStore* store) {
   gtk_list_store_clear(store);
-  std::string dir = get_setlists_directory();
-  GDir* gd = g_dir_open(dir.c_str(), 0, nullptr);
-  if (!gd) return;
-  const char* name = nullptr;
-  while ((name = g_dir_read_name(gd)) != nullptr) {
-    std::string n = name;
-    bool ok = false;
-    if (n.size() >= 4 && n.substr(n.size()-4) == ".lst") ok = true;
-    else if (n.size() >= 4 && n.substr(n.size()-4) == ".txt") ok = true;
-    else if (n.size() >= 8 && n.substr(n.size()-8) == ".setlist") ok = true;
-    if (!ok) continue;
-    GtkTreeIter it;
-    gtk_list_store_append(store, &it);
-    gtk_list_store_set(store, &it, 0, n.c_str(), -1);
+  int row = 0, selected_row = -1;
+  bool ready = false;
+  {
+    std::lock_guard<std::mutex> lock(s->catalog_mu);
+    ready = s->catalog_ready;
+    if (ready) {
+      for (const auto& entry : s->catalog) {
+        const SetlistInfo& info = entry.second;
+        char modified[32] = "";
+        const time_t t = (time_t)info.mtime;
+        struct tm tm;
+        if (localtime_r(&t, &tm)) strftime(modified, sizeof modified, "%Y-%m-%d %H:%M", &tm);
+        const std::string pages = (info.pages_unknown == 0) ? std::to_string(info.total_pages)
+                                  : (info.total_pages == 0) ? std::string("?")
+                                  : std::to_string(info.total_pages) + "+";
+        GtkTreeIter it;
+        gtk_list_store_append(store, &it);
+        gtk_list_store_set(store, &it, 0, entry.first.c_str(), 1, (int)info.items.size(), 2, pages.c_str(),
+                           3, modified, 4, info.missing, -1);
+        if (entry.first == selected) selected_row = row;
+        ++row;
+      }
+    }
   }
-  g_dir_close(gd);
+  if (!ready) {
+    std::string dir = get_setlists_directory();
+    GDir* gd = g_dir_open(dir.c_str(), 0, nullptr);
+    if (!gd) return;
+    const char* name = nullptr;
+    while ((name = g_dir_read_name(gd)) != nullptr) {
+      std::string n = name;
+      if (!is_setlist_file_name(n)) continue;
+      GtkTreeIter it;
+      gtk_list_store_append(store, &it);
+      gtk_list_store_set(store, &it, 0, n.c_str(), 1, 0, 2, "", 3, "", 4, 0, -1);
+      if (n == selected) selected_row = row;
+      ++row;
+    }
+    g_dir_close(gd);
+  }
+  if (selected_row >= 0 && s->manage_view) set_cursor_to_row(GTK_TREE_VIEW(s->manage_view), selected_row);
 }
 
 static bool manage_setlists_selected_path(GtkTreeView* view, std::string& out_path) {
@@ -1861,11 +6046,15 @@ static void manage_setlists_dialog(AppState* s) {
   gtk_container_set_border_width(GTK_CONTAINER(box), 10);
   gtk_container_add(GTK_CONTAINER(content), box);
 
-  GtkListStore* store = gtk_list_store_new(1, G_TYPE_STRING);
+  GtkListStore* store = gtk_list_store_new(5, G_TYPE_STRING, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_INT);
   GtkWidget* view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
   GtkCellRenderer* r = gtk_cell_renderer_text_new();
   GtkTreeViewColumn* c = gtk_tree_view_column_new_with_attributes("Setlists", r, "text", 0, nullptr);
   gtk_tree_view_append_column(GTK_TREE_VIEW(view), c);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Entries", r, "text", 1, nullptr));
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Pages", r, "text", 2, nullptr));
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Modified", r, "text", 3, nullptr));
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), gtk_tree_view_column_new_with_attributes("Missing", r, "text", 4, nullptr));
   gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), TRUE);
   GtkTreeSelection* sel = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
   gtk_tree_selection_set_mode(sel, GTK_SELECTION_BROWSE);
@@ -1875,9 +6064,11 @@ static void manage_setlists_dialog(AppState* s) {
   gtk_container_add(GTK_CONTAINER(sw), view);
   gtk_box_pack_start(GTK_BOX(box), sw, TRUE, TRUE, 0);
 
-  manage_setlists_refresh_store(store);
+  manage_setlists_refresh_store(s, store);
   if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(store), nullptr) > 0)
     set_cursor_to_row(GTK_TREE_VIEW(view), 0);
+  s->manage_store = store;
+  s->manage_view = view;
 
   gtk_widget_show_all(dlg);
   gtk_widget_grab_focus(view);
@@ -1894,6 +6085,8 @@ static void manage_setlists_dialog(AppState* s) {
     if (resp == RESP_OPEN) {
       std::string setlist_path;
       if (!manage_setlists_selected_path(GTK_TREE_VIEW(view), setlist_path)) continue;
+      s->manage_store = nullptr;
+      s->manage_view = nullptr;
       gtk_widget_destroy(dlg);
       s->return_to_manage_setlists = true;
       open_setlist_dialog_from_path(s, setlist_path);
@@ -1903,7 +6096,7 @@ static void manage_setlists_dialog(AppState* s) {
 
     if (resp == RESP_CREATE) {
       create_setlist_dialog(s);
-      manage_setlists_refresh_store(store);
+      manage_setlists_refresh_store(s, store);
       if (gtk_tree_model_iter_n_children(GTK_TREE_MODEL(store), nullptr) > 0)
         set_cursor_to_row(GTK_TREE_VIEW(view), 0);
       gtk_widget_grab_focus(view);
@@ -1914,7 +6107,7 @@ static void manage_setlists_dialog(AppState* s) {
     if (!manage_setlists_selected_path(GTK_TREE_VIEW(view), setlist_path)) continue;
 
     if (resp == RESP_EDIT) {
-      auto items = parse_setlist_file(setlist_path);
+      auto items = setlist_items(s, setlist_path);
       edit_setlist_file(s, setlist_path, items, false);
     } else if (resp == RESP_RENAME) {
       std::string new_path;
@@ -1937,28 +6130,152 @@ static void manage_setlists_dialog(AppState* s) {
       }
     }
 
-    manage_setlists_refresh_store(store);
+    manage_setlists_refresh_store(s, store);
     int count = gtk_tree_model_iter_n_children(GTK_TREE_MODEL(store), nullptr);
     if (count > 0) set_cursor_to_row(GTK_TREE_VIEW(view), 0);
     gtk_widget_grab_focus(view);
   }
 
+  s->manage_store = nullptr;
+  s->manage_view = nullptr;
   gtk_widget_destroy(dlg);
   g_object_unref(store);
 }
 
+// ===== Setlist entry validation
+static EntryStatus validate_setlist_entry(const std::string& path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return (errno == ENOENT || errno == ENOTDIR) ? ENTRY_MISSING : ENTRY_UNREADABLE;
+  if (!S_ISREG(st.st_mode)) return ENTRY_NOT_PDF;
+
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return ENTRY_UNREADABLE;
+  char head[1024] = {};
+  f.read(head, sizeof head);
+  const std::string h(head, (size_t)f.gcount());
+  if (h.find("%PDF-") == std::string::npos) return ENTRY_NOT_PDF;
+
+  // The trailer ends with %%EOF, possibly followed by a few bytes of padding.
+  const std::streamoff tail_len = std::min<std::streamoff>((std::streamoff)st.st_size, 1024);
+  f.clear();
+  f.seekg(-tail_len, std::ios::end);
+  std::string t((size_t)tail_len, '\0');
+  f.read(&t[0], tail_len);
+  if (!f) return ENTRY_UNREADABLE;
+  return t.find("%%EOF") != std::string::npos ? ENTRY_OK : ENTRY_TRUNCATED;
+}
+
+struct ValidationNotify {
+  AppState* s;
+  std::shared_ptr<SetlistValidation> job;
+};
+
+static gboolean setlist_validation_cb(gpointer user_data) {
+  ValidationNotify* n = (ValidationNotify*)user_data;
+  std::vector<std::pair<int, EntryStatus>> results;
+  {
+    std::lock_guard<std::mutex> lock(n->job->mu);
+    results.swap(n->job->results);
+    n->job->notify = nullptr;
+  }
+  AppState* s = n->s;
+  if (s->setlist_validation == n->job && s->setlist_store) {
+    static const char* const icons[] = { "emblem-ok-symbolic", "dialog-error-symbolic", "dialog-warning-symbolic",
+                                         "dialog-warning-symbolic", "dialog-error-symbolic" };
+    static const char* const tips[] = { "OK", "File not found (moved, renamed or deleted)", "Not a PDF file",
+                                        "PDF looks truncated (no %%EOF)", "Cannot be read" };
+    for (const auto& r : results) {
+      GtkTreeIter it;
+      if (!gtk_tree_model_iter_nth_child(GTK_TREE_MODEL(s->setlist_store), &it, nullptr, r.first)) continue;
+      gtk_list_store_set(s->setlist_store, &it, 2, icons[r.second], 3, tips[r.second], -1);
+    }
+  }
+  delete n;
+  return G_SOURCE_REMOVE;
+}
+
+// Joins the threads of every job whose workers have all returned.
+static gboolean setlist_validation_reap_cb(gpointer user_data) {
+  AppState* s = (AppState*)user_data;
+  for (auto it = s->validation_threads.begin(); it != s->validation_threads.end();) {
+    if (it->second->workers.load() > 0) {
+      ++it;
+      continue;
+    }
+    it->first.join();
+    it = s->validation_threads.erase(it);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+static void setlist_validation_worker(AppState* s, std::shared_ptr<SetlistValidation> job) {
+  for (size_t i = job->next++; i < job->order.size() && !job->cancelled.load(); i = job->next++) {
+    const int row = job->order[i];
+    const EntryStatus status = validate_setlist_entry(job->items[row]);
+    std::lock_guard<std::mutex> lock(job->mu);
+    job->results.push_back({ row, status });
+    if (!job->notify && !job->cancelled.load()) {
+      job->notify = new ValidationNotify{ s, job };
+      job->notify_source = g_idle_add(setlist_validation_cb, job->notify);
+    }
+  }
+  if (--job->workers == 0) g_idle_add(setlist_validation_reap_cb, s); // its last step
+}
+
+// Checks every entry, nearest to first_row first, with up to 8 threads: the work is
+// I/O latency (USB, NFS), not CPU.
+static void setlist_validation_start(AppState* s, const std::vector<std::string>& items, int first_row) {
+  auto job = std::make_shared<SetlistValidation>();
+  job->items = items;
+  const int n = (int)items.size();
+  for (int d = 0; d < n; ++d) {
+    if (first_row + d < n) job->order.push_back(first_row + d);
+    if (d > 0 && first_row - d >= 0) job->order.push_back(first_row - d);
+  }
+  s->setlist_validation = job;
+  const int threads = std::min(n, 8);
+  job->workers = threads;
+  for (int t = 0; t < threads; ++t)
+    s->validation_threads.emplace_back(std::thread(setlist_validation_worker, s, job), job);
+}
+
+static void setlist_validation_stop(AppState* s) {
+  if (s->setlist_validation) s->setlist_validation->cancelled = true;
+  s->setlist_validation.reset();
+  s->setlist_store = nullptr;
+}
+
+// At exit: waits for every validation thread and drops the results they queued.
+static void join_validation_threads(AppState* s) {
+  for (auto& entry : s->validation_threads) {
+    entry.second->cancelled = true;
+    entry.first.join();
+  }
+  for (auto& entry : s->validation_threads) {
+    SetlistValidation* job = entry.second.get();
+    if (!job->notify) continue;
+    g_source_remove(job->notify_source);
+    delete job->notify;
+    job->notify = nullptr;
+  }
+  s->validation_threads.clear();
+}
+
 static bool open_setlist_dialog_from_path(AppState* s, const std::string& setlist_path) {
-  auto items = parse_setlist_file(setlist_path);
+  auto items = setlist_items(s, setlist_path);
   if (items.empty()) {
     info_box(s, "Setlist vide ou illisible.");
     return false;
   }
 
+  enum { RESP_PLAY = 1001 };
+
   GtkWidget* dlg = gtk_dialog_new_with_buttons(
       "Setlist",
       GTK_WINDOW(s->window),
       (GtkDialogFlags)(GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT),
       "_Back", GTK_RESPONSE_CANCEL,
+      "_Play from here", RESP_PLAY,
       "_Open", GTK_RESPONSE_OK,
       nullptr);
   g_signal_connect(dlg, "key-press-event", G_CALLBACK(dialog_esc_to_cancel), nullptr);
@@ -1971,20 +6288,24 @@ static bool open_setlist_dialog_from_path(AppState* s, const std::string& setlis
   GtkWidget* label = gtk_label_new("Select a PDF from the setlist:");
   gtk_box_pack_start(GTK_BOX(box), label, FALSE, FALSE, 0);
 
-  GtkListStore* store = gtk_list_store_new(2, G_TYPE_INT, G_TYPE_STRING);
+  // #, file, status icon, status text (tooltip); icons arrive from setlist_validation_cb
+  GtkListStore* store = gtk_list_store_new(4, G_TYPE_INT, G_TYPE_STRING, G_TYPE_STRING, G_TYPE_STRING);
   for (size_t i = 0; i < items.size(); ++i) {
     GtkTreeIter it;
     gtk_list_store_append(store, &it);
-    gtk_list_store_set(store, &it, 0, (int)i + 1, 1, items[i].c_str(), -1);
+    gtk_list_store_set(store, &it, 0, (int)i + 1, 1, items[i].c_str(), 2, "content-loading-symbolic", 3, "Checking...", -1);
   }
 
   GtkWidget* view = gtk_tree_view_new_with_model(GTK_TREE_MODEL(store));
   g_object_unref(store);
   GtkCellRenderer* r = gtk_cell_renderer_text_new();
+  GtkTreeViewColumn* c0 = gtk_tree_view_column_new_with_attributes("", gtk_cell_renderer_pixbuf_new(), "icon-name", 2, nullptr);
   GtkTreeViewColumn* c1 = gtk_tree_view_column_new_with_attributes("#", r, "text", 0, nullptr);
   GtkTreeViewColumn* c2 = gtk_tree_view_column_new_with_attributes("File", r, "text", 1, nullptr);
+  gtk_tree_view_append_column(GTK_TREE_VIEW(view), c0);
   gtk_tree_view_append_column(GTK_TREE_VIEW(view), c1);
   gtk_tree_view_append_column(GTK_TREE_VIEW(view), c2);
+  gtk_tree_view_set_tooltip_column(GTK_TREE_VIEW(view), 3);
   gtk_tree_view_set_headers_visible(GTK_TREE_VIEW(view), TRUE);
   GtkTreeSelection* sel = gtk_tree_view_get_selection(GTK_TREE_VIEW(view));
   gtk_tree_selection_set_mode(sel, GTK_SELECTION_BROWSE);
@@ -2007,19 +6328,24 @@ static bool open_setlist_dialog_from_path(AppState* s, const std::string& setlis
   gtk_tree_path_free(p0);
   gtk_widget_grab_focus(view);
 
+  s->setlist_store = store;
+  setlist_validation_start(s, items, start_idx);
+
   dialog_begin(s, dlg);
   int resp = gtk_dialog_run(GTK_DIALOG(dlg));
   dialog_end(s);
+  setlist_validation_stop(s);
 
   bool ok = false;
-  if (resp == GTK_RESPONSE_OK) {
+  if (resp == GTK_RESPONSE_OK || resp == RESP_PLAY) {
     GtkTreeModel* model = nullptr;
     GtkTreeIter it;
     if (gtk_tree_selection_get_selected(sel, &model, &it)) {
+      int row = 0;
       GtkTreePath* path = gtk_tree_model_get_path(model, &it);
       if (path) {
         int* indices = gtk_tree_path_get_indices(path);
-        if (indices) s->last_setlist_index = indices[0];
+        if (indices) row = s->last_setlist_index = indices[0];
         gtk_tree_path_free(path);
       }
 
@@ -2031,17 +6357,23 @@ static bool open_setlist_dialog_from_path(AppState* s, const std::string& setlis
         if (chosen.empty() || chosen[0] != '/') {
           info_box(s, "Setlist error: Only absolute paths are allowed.");
           ok = false;
+        } else if (resp == RESP_PLAY) {
+          start_setlist_play(s, setlist_path, items, row);
+          ok = true;
         } else {
+          stop_setlist_play(s);
           s->active_setlist_path = setlist_path;
-          ok = load_document_from_path(s, chosen, true, true);
+          load_document_async(s, chosen, true, true);
+          ok = true;
         }
       }
     }
   }
   gtk_widget_destroy(dlg);
-  if (!ok && s->return_to_manage_setlists) {
+  if (s->return_to_manage_setlists) {
     s->return_to_manage_setlists = false;
-    manage_setlists_dialog(s);
+    if (!ok) manage_setlists_dialog(s);
+    else if (s->loading) s->loading->on_failure = manage_setlists_dialog; // decided when the open ends
   }
   return ok;
 }
@@ -2148,10 +6480,12 @@ static void show_main_menu_dialog(AppState* s) {
     dialog_end(s);
     switch (resp) {
       case 1:
-        if (choose_open_pdf(s)) done = true;
-        break;
       case 2:
-        if (open_setlist_dialog(s)) done = true;
+        // The menu comes back if the open started here fails or is cancelled.
+        if (resp == 1 ? choose_open_pdf(s) : open_setlist_dialog(s)) {
+          done = true;
+          if (s->loading && !s->loading->on_failure) s->loading->on_failure = show_main_menu_dialog;
+        }
         break;
       default:
         done = true;
@@ -2166,6 +6500,7 @@ static void on_menu_open(GtkWidget*, gpointer user_data) { choose_open_pdf((AppS
 static void on_menu_close(GtkWidget*, gpointer user_data) { close_current_document((AppState*)user_data); }
 static void on_menu_print(GtkWidget*, gpointer user_data) { print_document((AppState*)user_data); }
 static void on_menu_manage_setlists(GtkWidget*, gpointer user_data) { manage_setlists_dialog((AppState*)user_data); }
+static void on_menu_library(GtkWidget*, gpointer user_data) { library_dialog((AppState*)user_data); }
 static void on_menu_help(GtkWidget*, gpointer user_data) { show_help((AppState*)user_data); }
 static void on_menu_about(GtkWidget*, gpointer user_data) { show_about_box((AppState*)user_data); }
 static void on_menu_quit(GtkWidget*, gpointer) { gtk_main_quit(); }
@@ -2191,6 +6526,8 @@ static GtkWidget* build_menu_bar(AppState* s) {
   GtkWidget* setlists_menu = gtk_menu_new();
   GtkWidget* mi_manage_setlists = gtk_menu_item_new_with_mnemonic("_Manage Setlists");
   gtk_menu_shell_append(GTK_MENU_SHELL(setlists_menu), mi_manage_setlists);
+  GtkWidget* mi_library = gtk_menu_item_new_with_mnemonic("Search _Library...");
+  gtk_menu_shell_append(GTK_MENU_SHELL(setlists_menu), mi_library);
   gtk_menu_item_set_submenu(GTK_MENU_ITEM(setlists_item), setlists_menu);
 
   GtkWidget* help_item = gtk_menu_item_new_with_mnemonic("_Help");
@@ -2229,27 +6566,201 @@ static GtkWidget* build_menu_bar(AppState* s) {
   g_signal_connect(mi_print, "activate", G_CALLBACK(on_menu_print), s);
   g_signal_connect(mi_quit, "activate", G_CALLBACK(on_menu_quit), s);
   g_signal_connect(mi_manage_setlists, "activate", G_CALLBACK(on_menu_manage_setlists), s);
+  g_signal_connect(mi_library, "activate", G_CALLBACK(on_menu_library), s);
   g_signal_connect(mi_help, "activate", G_CALLBACK(on_menu_help), s);
   g_signal_connect(mi_about, "activate", G_CALLBACK(on_menu_about), s);
 
   return hbox;
 }
 
-int main(int argc, char** argv) {
-  gtk_init(&argc, &argv);
+// ===== Benchmark (--bench file.pdf)
+// Replays tests/rdScore_Performance_Test_Plan.docx against an offscreen window (which
+// still needs a display connection, e.g. xvfb-run):
+// open, 20 x next page, 5 x zoom in, scroll down and back up, extract pages 10-20.
+// Each step is timed until the viewport is drawn sharp; the result goes to stdout as JSON.
+struct BenchStep {
+  std::string name;
+  double ms = 0.0;
+  bool complete = false;
+};
 
-  ensure_setlists_directory();
+static bool bench_draw_until_complete(AppState* s, cairo_surface_t* target, double timeout_ms) {
+  const gint64 deadline = g_get_monotonic_time() + (gint64)(timeout_ms * 1000.0);
+  while (true) {
+    while (gtk_events_pending()) gtk_main_iteration_do(FALSE);
+    cairo_t* cr = cairo_create(target);
+    gtk_widget_draw(s->scrolled, cr);
+    cairo_destroy(cr);
+    if (s->last_draw_complete) return true;
+    if (g_get_monotonic_time() >= deadline) return false;
+    g_usleep(1000);
+  }
+}
+
+template <typename F>
+static void bench_step(AppState* s, cairo_surface_t* target, std::vector<BenchStep>& steps, const char* name, F action) {
+  const gint64 t0 = g_get_monotonic_time();
+  action();
+  BenchStep st;
+  st.name = name;
+  st.complete = bench_draw_until_complete(s, target, 10000.0);
+  st.ms = (g_get_monotonic_time() - t0) / 1000.0;
+  steps.push_back(st);
+}
+
+static int run_bench(AppState* s, const std::string& path) {
+  if (path.empty()) {
+    g_printerr("usage: rdScore --bench file.pdf\n");
+    return 2;
+  }
+
+  while (gtk_events_pending()) gtk_main_iteration_do(FALSE);
+  GtkAllocation a;
+  gtk_widget_get_allocation(s->scrolled, &a);
+  cairo_surface_t* target = cairo_image_surface_create(CAIRO_FORMAT_RGB24, std::max(1, a.width), std::max(1, a.height));
+
+  const gint64 t_open = g_get_monotonic_time();
+  if (!load_document_from_path(s, path, false)) {
+    g_printerr("rdScore: cannot open %s\n", path.c_str());
+    cairo_surface_destroy(target);
+    return 1;
+  }
+  const double open_ms = (g_get_monotonic_time() - t_open) / 1000.0;
+  const bool first_complete = bench_draw_until_complete(s, target, 10000.0);
+  const double first_render_ms = (g_get_monotonic_time() - t_open) / 1000.0;
+
+  std::vector<BenchStep> steps;
+  for (int i = 0; i < 20; ++i) bench_step(s, target, steps, "next_page", [s] { next_page(s); });
+  for (int i = 0; i < 5; ++i) bench_step(s, target, steps, "zoom_in", [s] { zoom_in(s); });
+  const double dy = std::max(1, a.height) * 0.5;
+  for (int i = 0; i < 5; ++i) bench_step(s, target, steps, "scroll_down", [s, dy] { scroll_by(s, 0, dy); });
+  for (int i = 0; i < 5; ++i) bench_step(s, target, steps, "scroll_up", [s, dy] { scroll_by(s, 0, -dy); });
+
+  const int p_from = std::min(10, s->n_pages);
+  const int p_to = std::min(20, s->n_pages);
+  const std::string out_pdf = std::string(g_get_tmp_dir()) + "/rdscore-bench-" + std::to_string((long)getpid()) + ".pdf";
+  // The same background job as Pages > Extract, timed until extract_done_cb has run.
+  const gint64 t_extract = g_get_monotonic_time();
+  s->extract_last_ok = false;
+  extract_start(s, s->input_pdf_abs, { { { { p_from, p_to } }, out_pdf } });
+  bool extract_complete = s->extracting != nullptr;
+  const gint64 extract_deadline = t_extract + (gint64)60000 * 1000;
+  while (s->extracting) {
+    while (gtk_events_pending()) gtk_main_iteration_do(FALSE);
+    if (!s->extracting) break;
+    if (extract_complete && g_get_monotonic_time() >= extract_deadline) {
+      extract_complete = false;
+      cancel_extraction(s); // still waited for: the thread uses s
+    }
+    g_usleep(1000);
+  }
+  const double extract_ms = (g_get_monotonic_time() - t_extract) / 1000.0;
+  const bool extracted = extract_complete && s->extract_last_ok;
+  std::error_code ec;
+  std::filesystem::remove(out_pdf, ec);
+
+  cairo_surface_destroy(target);
+
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  const double user_ms = ru.ru_utime.tv_sec * 1000.0 + ru.ru_utime.tv_usec / 1000.0;
+  const double sys_ms = ru.ru_stime.tv_sec * 1000.0 + ru.ru_stime.tv_usec / 1000.0;
+
+  // Steps that timed out are listed but kept out of the histogram.
+  Histogram step_ms;
+  int incomplete = 0;
+  for (const auto& st : steps) {
+    if (st.complete) histogram_add(step_ms, st.ms);
+    else ++incomplete;
+  }
+
+  std::ostringstream o;
+  o << "{\n";
+  o << "  \"version\": \"" << RDSCORE_VERSION << "\",\n";
+  o << "  \"document\": \"" << json_escape(s->input_pdf_abs) << "\",\n";
+  o << "  \"pages\": " << s->n_pages << ",\n";
+  o << "  \"viewport\": [" << a.width << ", " << a.height << "],\n";
+  o << "  \"open_ms\": " << open_ms << ",\n";
+  o << "  \"first_render_ms\": " << first_render_ms << ",\n";
+  o << "  \"first_render_complete\": " << (first_complete ? "true" : "false") << ",\n";
+  o << "  \"steps\": [";
+  for (size_t i = 0; i < steps.size(); ++i) {
+    o << (i ? ",\n    " : "\n    ")
+      << "{\"step\": \"" << steps[i].name << "\", \"ms\": " << steps[i].ms
+      << ", \"complete\": " << (steps[i].complete ? "true" : "false") << "}";
+  }
+  o << "\n  ],\n";
+  o << "  \"step_ms\": " << histogram_json(step_ms) << ",\n";
+  o << "  \"steps_incomplete\": " << incomplete << ",\n";
+  o << "  \"extract\": {\"pages\": [" << p_from << ", " << p_to << "], \"ok\": " << (extracted ? "true" : "false")
+    << ", \"complete\": " << (extract_complete ? "true" : "false") << ", \"ms\": " << extract_ms << "},\n";
+  {
+    std::lock_guard<std::mutex> lock(s->stats.mu);
+    o << "  \"render_ms\": " << histogram_json(s->stats.render_ms) << ",\n";
+  }
+  o << "  \"cpu_user_ms\": " << user_ms << ",\n";
+  o << "  \"cpu_sys_ms\": " << sys_ms << ",\n";
+  o << "  \"peak_rss_kb\": " << ru.ru_maxrss << "\n";
+  o << "}\n";
+  g_print("%s", o.str().c_str());
+  return extracted ? 0 : 1;
+}
 
+int main(int argc, char** argv) {
   if (argc == 2 && std::string(argv[1]) == "--version") {
     g_print("rdScore %s\n", RDSCORE_VERSION);
     return 0;
   }
 
+  // --bench draws through the same GTK widgets as the viewer (offscreen), so it
+  // needs a display too; say so instead of letting gtk_init abort.
+  if (!gtk_init_check(&argc, &argv)) {
+    bool bench = false;
+    for (int i = 1; i < argc; ++i) bench = bench || std::string(argv[i]) == "--bench";
+    if (bench) g_printerr("rdScore: --bench needs a display (it renders through GTK offscreen); run it under xvfb-run\n");
+    else g_printerr("rdScore: cannot open display\n");
+    return 1;
+  }
+
+  ensure_setlists_directory();
+
   AppState s;
   update_zoom_percent(&s);
-
-  s.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
-  gtk_window_set_default_size(GTK_WINDOW(s.window), 1200, 800);
+  s.budget.limit = default_memory_budget();
+
+  std::string open_path;
+  bool bench = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string arg = argv[i];
+    if (arg == "--bench") {
+      bench = true;
+    } else if (arg.rfind("--prefetch=", 0) == 0) {
+      s.prefetch_depth = clampi(atoi(arg.c_str() + 11), 0, 16);
+    } else if (arg.rfind("--disk-cache-mb=", 0) == 0) {
+      s.disk.limit = (size_t)std::max(0, atoi(arg.c_str() + 16)) << 20;
+    } else if (arg.rfind("--render-threads=", 0) == 0) {
+      s.render_threads = clampi(atoi(arg.c_str() + 17), 1, 16);
+    } else if (arg.rfind("--stats-file=", 0) == 0) {
+      s.stats_file = arg.substr(13);
+    } else if (arg.rfind("--cache-mb=", 0) == 0) {
+      s.budget.limit = (size_t)std::max(16, atoi(arg.c_str() + 11)) << 20;
+    } else if (open_path.empty()) {
+      open_path = arg;
+    }
+  }
+  if (!bench) disk_cache_init(&s.disk); // benchmarks measure cold renders
+  render_engine_start(&s);
+
+  if (bench) {
+    // Fixed-size offscreen window so runs compare across machines.
+    s.batch = true;
+    s.fullscreen = false;
+    s.window = gtk_offscreen_window_new();
+    gtk_widget_set_size_request(s.window, 1200, 800);
+  } else {
+    s.window = gtk_window_new(GTK_WINDOW_TOPLEVEL);
+    gtk_window_set_default_size(GTK_WINDOW(s.window), 1200, 800);
+  }
   gtk_window_set_title(GTK_WINDOW(s.window), "rdScore");
 
   GtkWidget* vbox = gtk_box_new(GTK_ORIENTATION_VERTICAL, 0);
@@ -2259,9 +6770,29 @@ int main(int argc, char** argv) {
   gtk_box_pack_start(GTK_BOX(vbox), menubar, FALSE, FALSE, 0);
   update_status_label(&s);
 
+  GtkWidget* overlay = gtk_overlay_new();
+  gtk_box_pack_start(GTK_BOX(vbox), overlay, TRUE, TRUE, 0);
+
   s.scrolled = gtk_scrolled_window_new(nullptr, nullptr);
   gtk_scrolled_window_set_policy(GTK_SCROLLED_WINDOW(s.scrolled), GTK_POLICY_AUTOMATIC, GTK_POLICY_AUTOMATIC);
-  gtk_box_pack_start(GTK_BOX(vbox), s.scrolled, TRUE, TRUE, 0);
+  gtk_container_add(GTK_CONTAINER(overlay), s.scrolled);
+
+  s.overlay_area = gtk_drawing_area_new();
+  gtk_widget_set_can_focus(s.overlay_area, FALSE);
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), s.overlay_area);
+  gtk_overlay_set_overlay_pass_through(GTK_OVERLAY(overlay), s.overlay_area, TRUE);
+
+  s.search_entry = gtk_search_entry_new();
+  gtk_widget_set_halign(s.search_entry, GTK_ALIGN_END);
+  gtk_widget_set_valign(s.search_entry, GTK_ALIGN_START);
+  gtk_widget_set_margin_top(s.search_entry, 8);
+  gtk_widget_set_margin_end(s.search_entry, 8);
+  gtk_entry_set_width_chars(GTK_ENTRY(s.search_entry), 28);
+  gtk_widget_set_no_show_all(s.search_entry, TRUE);
+  gtk_overlay_add_overlay(GTK_OVERLAY(overlay), s.search_entry);
+  g_signal_connect(s.search_entry, "changed", G_CALLBACK(on_search_changed), &s);
+  g_signal_connect(s.search_entry, "activate", G_CALLBACK(on_search_activate), &s);
+  g_signal_connect(s.search_entry, "key-press-event", G_CALLBACK(on_search_key), &s);
 
   s.drawing = gtk_drawing_area_new();
   gtk_container_add(GTK_CONTAINER(s.scrolled), s.drawing);
@@ -2271,16 +6802,22 @@ int main(int argc, char** argv) {
   g_signal_connect(s.window, "realize", G_CALLBACK(on_realize), &s);
   g_signal_connect(s.scrolled, "size-allocate", G_CALLBACK(on_size_allocate), &s);
   g_signal_connect(s.drawing, "draw", G_CALLBACK(on_draw), &s);
+  g_signal_connect(s.overlay_area, "draw", G_CALLBACK(on_draw_overlay), &s);
+  gtk_widget_add_events(s.drawing, GDK_BUTTON_PRESS_MASK);
+  g_signal_connect(s.drawing, "button-press-event", G_CALLBACK(on_button_press), &s);
 
   gtk_widget_show_all(s.window);
 
-  if (argc >= 2) {
-    if (!load_document_from_path(&s, argv[1], true)) {
-      unload_document(&s);
-    }
-  }
+  int rc = 0;
+  if (bench) {
+    rc = run_bench(&s, open_path);
+  } else {
+    if (!open_path.empty()) load_document_async(&s, open_path, true);
+    library_index_refresh(&s);
+    setlist_catalog_start(&s);
 
-  gtk_main();
+    gtk_main();
+  }
 
   if (s.zoom_overlay_timer) {
     g_source_remove(s.zoom_overlay_timer);
@@ -2290,7 +6827,26 @@ int main(int argc, char** argv) {
     g_source_remove(s.page_overlay_timer);
     s.page_overlay_timer = 0;
   }
+  if (s.zoom_settle_timer) {
+    g_source_remove(s.zoom_settle_timer);
+    s.zoom_settle_timer = 0;
+  }
 
+  cancel_document_load(&s);
+  cancel_extraction(&s);
+  if (s.extract_thread.joinable()) s.extract_thread.join();
+  delete s.extracting; // its extract_done_cb will not run any more
+  s.extracting = nullptr;
+  search_stop(&s);
+  library_index_stop(&s);
+  setlist_catalog_stop(&s);
+  stop_setlist_play(&s);
+  join_load_threads(&s);
+  join_validation_threads(&s);
+  render_engine_stop(&s);
+  disk_cache_stop(&s.disk);
+  if (!s.stats_file.empty()) write_render_stats(&s, s.stats_file);
   unload_document(&s);
-  return 0;
+  if (s.badge_measure_cr) cairo_destroy(s.badge_measure_cr);
+  return rc;
 }